@@ -0,0 +1,226 @@
+// Microbenchmark for every crc32_* kernel.
+//
+// Prints one CSV (or JSON) record per kernel, buffer size, alignment and cache state:
+//   bench_crc32 [--min-size N] [--max-size N] [--step N] [--kernel NAME] [--min-time SECONDS] [--json]
+// hot runs repeat until --min-time has passed, cold runs evict the caches before each of --cold-runs calls.
+// cycles_per_byte is based on the time stamp counter (reference cycles, 0 where unavailable).
+
+#include "crc32.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define HAVE_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Kernel = uint32_t(*)(const void* data, size_t length, uint32_t previousCrc32);
+
+struct KernelInfo {
+    const char* name;
+    Kernel kernel;
+};
+
+const KernelInfo Kernels[] = {
+    { "bitwise", [](const void* d, size_t n, uint32_t c) { return crc32_bitwise(d, n, c); } },
+    { "halfbyte", [](const void* d, size_t n, uint32_t c) { return crc32_halfbyte(d, n, c); } },
+#ifdef CRC32_USE_LOOKUP_TABLE_BYTE
+    { "1byte", [](const void* d, size_t n, uint32_t c) { return crc32_1byte(d, n, c); } },
+#endif
+    { "1byte_tableless", [](const void* d, size_t n, uint32_t c) { return crc32_1byte_tableless(d, n, c); } },
+    { "1byte_tableless2", [](const void* d, size_t n, uint32_t c) { return crc32_1byte_tableless2(d, n, c); } },
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_4
+    { "4bytes", [](const void* d, size_t n, uint32_t c) { return crc32_4bytes(d, n, c); } },
+#endif
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_8
+    { "8bytes", [](const void* d, size_t n, uint32_t c) { return crc32_8bytes(d, n, c); } },
+    { "4x8bytes", [](const void* d, size_t n, uint32_t c) { return crc32_4x8bytes(d, n, c); } },
+#endif
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+    { "16bytes", [](const void* d, size_t n, uint32_t c) { return crc32_16bytes(d, n, c); } },
+    { "16bytes_prefetch", [](const void* d, size_t n, uint32_t c) { return crc32_16bytes_prefetch(d, n, c); } },
+#endif
+    { "fast", [](const void* d, size_t n, uint32_t c) { return crc32_fast(d, n, c); } },
+};
+
+struct Options {
+    size_t minSize = 16;
+    size_t maxSize = (size_t)1 << 30;
+    size_t step = 4;
+    double minTime = 0.1;
+    size_t evictSize = 64 << 20;
+    size_t coldRuns = 8;
+    std::string kernel;
+    bool json = false;
+};
+
+struct Measurement {
+    double seconds = 0;
+    uint64_t cycles = 0;
+    uint64_t bytes = 0;
+};
+
+uint64_t ReadCycles() {
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/// write a buffer larger than the last level cache so the next run starts from DRAM
+void EvictCaches(std::vector<uint8_t>& scratch) {
+    static uint8_t value = 0;
+    value++;
+    for (size_t i = 0; i < scratch.size(); i += 64) {
+        scratch[i] = value;
+    }
+}
+
+Measurement Run(const KernelInfo& info, const uint8_t* data, size_t size, bool cold, const Options& options, std::vector<uint8_t>& scratch) {
+    Measurement m;
+    volatile uint32_t sink = 0;
+
+    if (cold) {
+        // every run starts from DRAM, eviction is not part of the timing
+        for (size_t run = 0; run < options.coldRuns; run++) {
+            EvictCaches(scratch);
+            auto start = Clock::now();
+            uint64_t startCycles = ReadCycles();
+            sink = info.kernel(data, size, sink);
+            m.cycles += ReadCycles() - startCycles;
+            m.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            m.bytes += size;
+        }
+        return m;
+    }
+
+    // warm up, then time batches so clock overhead doesn't dominate tiny buffers
+    sink = info.kernel(data, size, 0);
+    for (uint64_t batch = 1; m.seconds < options.minTime; batch *= 2) {
+        auto start = Clock::now();
+        uint64_t startCycles = ReadCycles();
+        for (uint64_t i = 0; i < batch; i++) {
+            sink = info.kernel(data, size, sink);
+        }
+        m.cycles += ReadCycles() - startCycles;
+        m.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        m.bytes += batch * size;
+    }
+    return m;
+}
+
+bool ParseSize(const char* text, size_t& out) {
+    char* end = nullptr;
+    unsigned long long value = strtoull(text, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+    }
+    out = (size_t)value;
+    return end != text && *end == 0;
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--min-size" && hasValue) {
+            if (!ParseSize(argv[++i], options.minSize)) return false;
+        } else if (arg == "--max-size" && hasValue) {
+            if (!ParseSize(argv[++i], options.maxSize)) return false;
+        } else if (arg == "--step" && hasValue) {
+            if (!ParseSize(argv[++i], options.step) || options.step < 2) return false;
+        } else if (arg == "--evict-size" && hasValue) {
+            if (!ParseSize(argv[++i], options.evictSize)) return false;
+        } else if (arg == "--cold-runs" && hasValue) {
+            if (!ParseSize(argv[++i], options.coldRuns) || options.coldRuns == 0) return false;
+        } else if (arg == "--min-time" && hasValue) {
+            options.minTime = atof(argv[++i]);
+        } else if (arg == "--kernel" && hasValue) {
+            options.kernel = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return options.minSize > 0 && options.minSize <= options.maxSize;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        fprintf(stderr,
+            "usage: %s [--min-size N] [--max-size N] [--step N] [--kernel NAME]\n"
+            "          [--min-time SECONDS] [--evict-size N] [--cold-runs N] [--json]\n"
+            "sizes accept K, M and G suffixes\n", argv[0]);
+        return 1;
+    }
+
+#ifndef NDEBUG
+    fprintf(stderr, "warning: benchmark was built without optimizations\n");
+#endif
+
+    // one extra byte so the misaligned run can start at offset 1
+    std::vector<uint8_t> data(options.maxSize + 1);
+    uint32_t state = 0x12345678;
+    for (auto& byte : data) {
+        state = state * 1664525 + 1013904223;
+        byte = (uint8_t)(state >> 24);
+    }
+    std::vector<uint8_t> scratch(options.evictSize);
+
+    if (!options.json) {
+        printf("kernel,size,offset,cache,correct,gb_per_s,cycles_per_byte\n");
+    }
+
+    for (const KernelInfo& info : Kernels) {
+        if (!options.kernel.empty() && options.kernel != info.name) {
+            continue;
+        }
+
+        for (size_t size = options.minSize; size <= options.maxSize; size *= options.step) {
+            // verify against the reference before trusting any timing
+            size_t checked = size < 4096 ? size : 4096;
+            bool correct = info.kernel(data.data() + 1, checked, 0) == crc32_bitwise(data.data() + 1, checked, 0);
+
+            for (size_t offset : { (size_t)0, (size_t)1 }) {
+                for (bool cold : { false, true }) {
+                    Measurement m = Run(info, data.data() + offset, size, cold, options, scratch);
+                    double gbPerSecond = m.bytes / m.seconds / 1e9;
+                    double cyclesPerByte = (double)m.cycles / m.bytes;
+                    const char* cache = cold ? "cold" : "hot";
+                    if (options.json) {
+                        printf("{\"kernel\":\"%s\",\"size\":%zu,\"offset\":%zu,\"cache\":\"%s\",\"correct\":%s,\"gb_per_s\":%.4f,\"cycles_per_byte\":%.4f}\n",
+                            info.name, size, offset, cache, correct ? "true" : "false", gbPerSecond, cyclesPerByte);
+                    } else {
+                        printf("%s,%zu,%zu,%s,%d,%.4f,%.4f\n",
+                            info.name, size, offset, cache, (int)correct, gbPerSecond, cyclesPerByte);
+                    }
+                    fflush(stdout);
+                }
+            }
+
+            if (size > options.maxSize / options.step) {
+                break;
+            }
+        }
+    }
+    return 0;
+}
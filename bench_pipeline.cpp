@@ -0,0 +1,514 @@
+// End-to-end throughput benchmark of the file hashing pipeline.
+//
+// Generates reproducible file trees below --root (reused on later runs with the same
+// --seed and --scale), hashes every file with the same engine as the GUI and prints
+// files/s, MB/s and the time spent per stage as CSV (or JSON with --json):
+//   bench_pipeline [--root DIR] [--scale F] [--seed N] [--tree NAME] [--threads N]
+//                  [--checksum crc32|crc32c|crc64] [--cache hot|cold|both] [--batch N] [--numa]
+//                  [--order listed|disk] [--json]
+// Stage times are summed over all worker threads. With --batch N workers take N files at
+// a time and hash them with HashFiles (small ones side by side), otherwise one by one as the GUI does.
+// Cold runs drop each file from the page cache first (posix_fadvise, POSIX only).
+// With --numa the workers are bound to the NUMA nodes in turn and every run adds one row per
+// node (node column) with the files, bytes and stage times of its workers, seconds until its last one finished.
+// --order disk hashes the files sorted by their place on the disk instead of by name, each device's
+// sweep by a single worker as equals-cli does; travel_mb is the distance the disk head covers between
+// files in the order the workers actually started them (0 where the places are unknown), best seen on
+// the scattered tree in a loop-mounted image (losetup --direct-io=on).
+
+#include "diskorder.h"
+#include "filehash.h"
+#include "numa.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    fs::path root = fs::temp_directory_path() / "equals-bench";
+    double scale = 1;
+    uint64_t seed = 1;
+    std::string tree;
+    ChecksumType checksum = ChecksumType::Crc32;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool hot = true;
+    bool cold = true;
+    bool json = false;
+    bool numa = false;
+    bool diskOrder = false;
+    size_t batch = 1;
+};
+
+/// xorshift64*, fixed so trees are identical across platforms and runs
+struct Random {
+    explicit Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+    uint64_t Next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1Dull;
+    }
+
+    uint64_t Below(uint64_t limit) {
+        return limit ? Next() % limit : 0;
+    }
+
+    void Fill(std::vector<char>& buffer) {
+        for (size_t i = 0; i + 8 <= buffer.size(); i += 8) {
+            uint64_t value = Next();
+            memcpy(buffer.data() + i, &value, 8);
+        }
+        for (size_t i = buffer.size() & ~(size_t)7; i < buffer.size(); i++) {
+            buffer[i] = (char)Next();
+        }
+    }
+
+    uint64_t state;
+};
+
+/// seed of a tree: FNV-1a over its name, unlike std::hash the same with every standard library
+uint64_t TreeSeed(uint64_t seed, const std::string& name) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (char c : name) {
+        hash ^= (uint8_t)c;
+        hash *= 0x100000001B3ull;
+    }
+    return seed ^ hash;
+}
+
+size_t Scaled(double count, double scale) {
+    return std::max<size_t>(1, (size_t)(count * scale));
+}
+
+void WriteRandomFile(const fs::path& path, uint64_t size, Random& random) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    std::vector<char> buffer;
+    while (size) {
+        buffer.resize((size_t)std::min<uint64_t>(size, 1 << 20));
+        random.Fill(buffer);
+        file.write(buffer.data(), buffer.size());
+        size -= buffer.size();
+    }
+}
+
+/// many files between 0 and 4 KiB, spread over 100 directories
+void GenerateTiny(const fs::path& dir, Random& random, double scale) {
+    size_t count = Scaled(20000, scale);
+    for (size_t i = 0; i < count; i++) {
+        fs::path sub = dir / std::to_string(i % 100);
+        fs::create_directories(sub);
+        WriteRandomFile(sub / (std::to_string(i) + ".bin"), random.Below(4097), random);
+    }
+}
+
+/// two files of 512 MiB
+void GenerateHuge(const fs::path& dir, Random& random, double scale) {
+    for (int i = 0; i < 2; i++) {
+        WriteRandomFile(dir / (std::to_string(i) + ".bin"), Scaled(512.0 * 1024 * 1024, scale), random);
+    }
+}
+
+/// 1 MiB files that differ from each other in a single byte
+void GenerateNearDuplicates(const fs::path& dir, Random& random, double scale) {
+    std::vector<char> content(1024 * 1024);
+    random.Fill(content);
+    size_t count = Scaled(128, scale);
+    for (size_t i = 0; i < count; i++) {
+        std::vector<char> copy = content;
+        copy[(size_t)random.Below(copy.size())] ^= 1;
+        std::ofstream(dir / (std::to_string(i) + ".bin"), std::ios::binary).write(copy.data(), copy.size());
+    }
+}
+
+/// two 1 GiB files holding sixteen 256 KiB data extents, the rest are holes where supported
+void GenerateSparse(const fs::path& dir, Random& random, double scale) {
+    const uint64_t Extent = 256 * 1024;
+    uint64_t size = std::max<uint64_t>(Scaled(1024.0 * 1024 * 1024, scale), 16 * Extent);
+    std::vector<char> buffer(Extent);
+    for (int i = 0; i < 2; i++) {
+        std::ofstream file(dir / (std::to_string(i) + ".img"), std::ios::binary);
+        for (uint64_t e = 0; e < 16; e++) {
+            random.Fill(buffer);
+            file.seekp((std::streamoff)(e * (size / 16)));
+            file.write(buffer.data(), buffer.size());
+        }
+        file.close();
+        fs::resize_file(dir / (std::to_string(i) + ".img"), size);
+    }
+}
+
+/// four directory chains 64 levels deep with four 16 KiB files per level
+void GenerateDeep(const fs::path& dir, Random& random, double scale) {
+    size_t depth = Scaled(64, scale);
+    for (int chain = 0; chain < 4; chain++) {
+        fs::path current = dir / std::to_string(chain);
+        for (size_t level = 0; level < depth; level++) {
+            current /= "d" + std::to_string(level);
+            fs::create_directories(current);
+            for (int i = 0; i < 4; i++) {
+                WriteRandomFile(current / (std::to_string(i) + ".bin"), 16 * 1024, random);
+            }
+        }
+    }
+}
+
+/// 256 KiB files written in shuffled order, so that their order on the disk differs from that of their names
+void GenerateScattered(const fs::path& dir, Random& random, double scale) {
+    size_t count = Scaled(1024, scale);
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    for (size_t i = count - 1; i > 0; i--) {
+        std::swap(order[i], order[(size_t)random.Below(i + 1)]);
+    }
+    for (size_t i : order) {
+        fs::path path = dir / (std::to_string(i) + ".bin");
+        WriteRandomFile(path, 256 * 1024, random);
+#ifndef _WIN32
+        // allocate the blocks now, delayed allocation would place the files in an order of its own
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fdatasync(fd);
+            close(fd);
+        }
+#endif
+    }
+}
+
+struct Tree {
+    const char* name;
+    void (*generate)(const fs::path& dir, Random& random, double scale);
+};
+
+const Tree Trees[] = {
+    { "tiny", GenerateTiny },
+    { "huge", GenerateHuge },
+    { "neardup", GenerateNearDuplicates },
+    { "sparse", GenerateSparse },
+    { "deep", GenerateDeep },
+    { "scattered", GenerateScattered },
+};
+
+/// (re)create a tree unless a previous run left one with the same parameters
+void PrepareTree(const Tree& tree, const Options& options) {
+    fs::path dir = options.root / tree.name;
+    uint64_t seed = TreeSeed(options.seed, tree.name);
+    std::string stamp = std::to_string(seed) + " " + std::to_string(options.scale);
+
+    std::string existing;
+    std::getline(std::ifstream(dir / ".complete"), existing);
+    if (existing == stamp) {
+        return;
+    }
+
+    fprintf(stderr, "generating %s\n", dir.string().c_str());
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    Random random(seed);
+    tree.generate(dir, random, options.scale);
+    std::ofstream(dir / ".complete") << stamp;
+}
+
+std::vector<fs::path> ListFiles(const fs::path& dir) {
+    std::vector<fs::path> files;
+    for (auto& entry : fs::recursive_directory_iterator(dir)) {
+        if (entry.is_regular_file() && entry.path().filename() != ".complete") {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+bool DropFromPageCache(const fs::path& path) {
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    // dirty pages can't be dropped, write them back first
+    fdatasync(fd);
+    bool dropped = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return dropped;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+struct RunResult {
+    size_t files = 0;
+    uint64_t bytes = 0;
+    size_t errors = 0;
+    double seconds = 0;
+    FileHashTimings timings;
+    /// bytes the disk head moves between files in the order the workers start them
+    uint64_t travel = 0;
+    /// with --numa, the share of each node
+    std::vector<RunResult> nodes;
+};
+
+/// sum of the jumps from the end of one file to the start of the next, files taken in the order of
+/// indices, for files whose place is known
+uint64_t HeadTravel(const std::vector<fs::path>& files, const std::vector<size_t>& indices) {
+    uint64_t travel = 0;
+    uint64_t position = 0;
+    bool started = false;
+    for (size_t i : indices) {
+        const fs::path& file = files[i];
+        uint64_t offset;
+        std::error_code ec{};
+        uint64_t size = fs::file_size(file, ec);
+        if (ec || !FirstPhysicalOffset(file, offset)) {
+            continue;
+        }
+        if (started) {
+            travel += offset > position ? offset - position : position - offset;
+        }
+        started = true;
+        position = offset + size;
+    }
+    return travel;
+}
+
+/// sweeps as from SortByDiskOffset, each handed to a single worker before the other files are shared out
+RunResult Run(const std::vector<fs::path>& files, const Options& options, const std::vector<std::vector<size_t>>& sweeps) {
+    RunResult run;
+    std::vector<size_t> shared;
+    std::vector<bool> swept(files.size(), false);
+    for (const std::vector<size_t>& sweep : sweeps) {
+        for (size_t i : sweep) {
+            swept[i] = true;
+        }
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!swept[i]) {
+            shared.push_back(i);
+        }
+    }
+    std::atomic<size_t> next{ 0 };
+    std::atomic<size_t> nextSweep{ 0 };
+    std::mutex mtx;
+    // file indices in the order their hashing started
+    std::vector<size_t> issued;
+    issued.reserve(files.size());
+    std::vector<std::pair<std::wstring, FileHash>> delivered;
+    delivered.reserve(files.size());
+
+    int nodeCount = options.numa ? NumaNodeCount() : 0;
+    run.nodes.resize(nodeCount);
+
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < options.threads; t++) {
+        threads.emplace_back([&, node = nodeCount ? (int)(t % nodeCount) : -1]() {
+            if (node >= 0) {
+                BindThreadToNumaNode(node);
+            }
+            RunResult own;
+            FileHashTimings timings;
+            auto hashBatch = [&](const std::vector<size_t>& list, size_t begin) {
+                std::vector<fs::path> paths;
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    for (size_t i = begin; i < std::min(begin + options.batch, list.size()); i++) {
+                        issued.push_back(list[i]);
+                    }
+                }
+                for (size_t i = begin; i < std::min(begin + options.batch, list.size()); i++) {
+                    paths.push_back(CanonicalPath(files[list[i]], &timings));
+                }
+                std::vector<FileHash> hashes;
+                if (options.batch == 1) {
+                    hashes.push_back(HashFile(paths[0], options.checksum, nullptr, &timings));
+                } else {
+                    hashes = HashFiles(paths, options.checksum, &timings);
+                }
+                // counted before delivering, which moves the results away
+                for (const FileHash& hash : hashes) {
+                    own.files++;
+                    own.bytes += hash.size;
+                    own.errors += !hash.error.empty();
+                }
+
+                // stands in for posting the results to the GUI thread
+                for (size_t i = 0; i < paths.size(); i++) {
+                    auto deliverStart = Clock::now();
+                    {
+                        std::lock_guard<std::mutex> lock(mtx);
+                        delivered.emplace_back(paths[i].wstring(), std::move(hashes[i]));
+                    }
+                    timings.deliver += std::chrono::duration<double>(Clock::now() - deliverStart).count();
+                }
+            };
+            for (size_t s; (s = nextSweep++) < sweeps.size(); ) {
+                for (size_t begin = 0; begin < sweeps[s].size(); begin += options.batch) {
+                    hashBatch(sweeps[s], begin);
+                }
+            }
+            for (size_t begin; (begin = next.fetch_add(options.batch)) < shared.size(); ) {
+                hashBatch(shared, begin);
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            run.timings += timings;
+            if (node >= 0) {
+                RunResult& share = run.nodes[node];
+                share.files += own.files;
+                share.bytes += own.bytes;
+                share.errors += own.errors;
+                share.timings += timings;
+                share.seconds = std::max(share.seconds, std::chrono::duration<double>(Clock::now() - start).count());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    run.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    run.travel = HeadTravel(files, issued);
+
+    run.files = delivered.size();
+    for (auto& result : delivered) {
+        run.bytes += result.second.size;
+        run.errors += !result.second.error.empty();
+    }
+    return run;
+}
+
+/// one row, node is "all" for the whole run
+void PrintRow(const Options& options, const char* tree, const char* cache, const std::string& node, const RunResult& run) {
+    double mb = run.bytes / 1e6;
+    const FileHashTimings& t = run.timings;
+    if (options.json) {
+        printf("{\"tree\":\"%s\",\"cache\":\"%s\",\"node\":\"%s\",\"files\":%zu,\"errors\":%zu,\"bytes\":%llu,\"seconds\":%.4f,"
+            "\"files_per_s\":%.1f,\"mb_per_s\":%.1f,\"canonicalize_s\":%.4f,\"open_s\":%.4f,"
+            "\"read_s\":%.4f,\"hash_s\":%.4f,\"deliver_s\":%.4f,\"travel_mb\":%.1f}\n",
+            tree, cache, node.c_str(), run.files, run.errors, (unsigned long long)run.bytes, run.seconds,
+            run.files / run.seconds, mb / run.seconds, t.canonicalize, t.open, t.read, t.hash, t.deliver, run.travel / 1e6);
+    } else {
+        printf("%s,%s,%s,%zu,%zu,%llu,%.4f,%.1f,%.1f,%.4f,%.4f,%.4f,%.4f,%.4f,%.1f\n",
+            tree, cache, node.c_str(), run.files, run.errors, (unsigned long long)run.bytes, run.seconds,
+            run.files / run.seconds, mb / run.seconds, t.canonicalize, t.open, t.read, t.hash, t.deliver, run.travel / 1e6);
+    }
+}
+
+void Print(const Options& options, const char* tree, const char* cache, const RunResult& run) {
+    PrintRow(options, tree, cache, "all", run);
+    for (size_t node = 0; node < run.nodes.size(); node++) {
+        PrintRow(options, tree, cache, std::to_string(node), run.nodes[node]);
+    }
+    fflush(stdout);
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--numa") {
+            options.numa = true;
+        } else if (arg == "--order" && hasValue) {
+            std::string order = argv[++i];
+            if (order != "listed" && order != "disk") return false;
+            options.diskOrder = order == "disk";
+        } else if (arg == "--root" && hasValue) {
+            options.root = argv[++i];
+        } else if (arg == "--scale" && hasValue) {
+            options.scale = atof(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--tree" && hasValue) {
+            options.tree = argv[++i];
+        } else if (arg == "--checksum" && hasValue) {
+            if (!ParseChecksumType(fs::path(argv[++i]).wstring(), options.checksum)) return false;
+        } else if (arg == "--batch" && hasValue) {
+            options.batch = (size_t)atoi(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = (unsigned)atoi(argv[++i]);
+        } else if (arg == "--cache" && hasValue) {
+            std::string cache = argv[++i];
+            options.hot = cache == "hot" || cache == "both";
+            options.cold = cache == "cold" || cache == "both";
+        } else {
+            return false;
+        }
+    }
+    return options.scale > 0 && options.threads > 0 && options.batch > 0 && (options.hot || options.cold);
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        fprintf(stderr,
+            "usage: %s [--root DIR] [--scale F] [--seed N] [--tree NAME] [--threads N]\n"
+            "          [--checksum crc32|crc32c|crc64] [--cache hot|cold|both] [--batch N] [--numa]\n"
+            "          [--order listed|disk] [--json]\n"
+            "trees: tiny, huge, neardup, sparse, deep, scattered\n", argv[0]);
+        return 1;
+    }
+
+    if (!options.json) {
+        printf("tree,cache,node,files,errors,bytes,seconds,files_per_s,mb_per_s,canonicalize_s,open_s,read_s,hash_s,deliver_s,travel_mb\n");
+    }
+
+    for (const Tree& tree : Trees) {
+        if (!options.tree.empty() && options.tree != tree.name) {
+            continue;
+        }
+
+        PrepareTree(tree, options);
+        std::vector<fs::path> files = ListFiles(options.root / tree.name);
+        std::vector<std::vector<size_t>> sweeps;
+        if (options.diskOrder) {
+            SortByDiskOffset(files, false, &sweeps);
+        }
+
+        if (options.cold) {
+            bool dropped = true;
+            for (auto& file : files) {
+                dropped &= DropFromPageCache(file);
+            }
+            if (dropped) {
+                RunResult run = Run(files, options, sweeps);
+                Print(options, tree.name, "cold", run);
+            } else {
+                fprintf(stderr, "%s: can't drop the page cache, skipping cold run\n", tree.name);
+            }
+        }
+
+        if (options.hot) {
+            // make sure everything is cached, then measure
+            Run(files, options, sweeps);
+            RunResult run = Run(files, options, sweeps);
+            Print(options, tree.name, "hot", run);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "blockmap.h"
+
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+
+namespace {
+
+const char Magic[8] = { 'E', 'Q', 'B', 'L', 'K', 'M', 'A', 'P' };
+const uint32_t Version = 1;
+
+/// header: magic, version, checksum type, block size, file size; the checksums follow
+const size_t HeaderSize = sizeof(Magic) + 4 + 4 + 8 + 8;
+
+void PutLittleEndian(uint8_t* to, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        to[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+uint64_t GetLittleEndian(const uint8_t* from, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= (uint64_t)from[i] << (8 * i);
+    }
+    return value;
+}
+
+size_t ChecksumBytes(ChecksumType type) {
+    return (size_t)ChecksumDigits(type) / 2;
+}
+
+} // anonymous namespace
+
+uint64_t BlockMap::Checksum() const {
+    uint64_t checksum = 0;
+    for (size_t i = 0; i < checksums.size(); i++) {
+        uint64_t length = std::min(blockSize, size - i * blockSize);
+        checksum = i ? CombineChecksums(type, checksum, checksums[i], length) : checksums[i];
+    }
+    return checksum;
+}
+
+bool BlockMap::Save(const std::filesystem::path& path) const {
+    size_t bytes = ChecksumBytes(type);
+    std::vector<uint8_t> data(HeaderSize + checksums.size() * bytes);
+    memcpy(data.data(), Magic, sizeof(Magic));
+    PutLittleEndian(&data[8], Version, 4);
+    PutLittleEndian(&data[12], (uint64_t)type, 4);
+    PutLittleEndian(&data[16], blockSize, 8);
+    PutLittleEndian(&data[24], size, 8);
+    for (size_t i = 0; i < checksums.size(); i++) {
+        PutLittleEndian(&data[HeaderSize + i * bytes], checksums[i], bytes);
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write((const char*)data.data(), (std::streamsize)data.size());
+    return (bool)file.flush();
+}
+
+bool BlockMap::Load(const std::filesystem::path& path, std::wstring& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = L"Failed to open file";
+        return false;
+    }
+    uint8_t header[HeaderSize];
+    if (!file.read((char*)header, HeaderSize) || memcmp(header, Magic, sizeof(Magic)) != 0) {
+        error = L"Not a block map";
+        return false;
+    }
+    uint64_t typeValue = GetLittleEndian(&header[12], 4);
+    blockSize = GetLittleEndian(&header[16], 8);
+    size = GetLittleEndian(&header[24], 8);
+    if (GetLittleEndian(&header[8], 4) != Version || typeValue > (uint64_t)ChecksumType::Crc64 || blockSize == 0) {
+        error = L"Unsupported block map";
+        return false;
+    }
+    type = (ChecksumType)typeValue;
+
+    uint64_t count = size / blockSize + (size % blockSize != 0);
+    size_t bytes = ChecksumBytes(type);
+    if (count > SIZE_MAX / bytes) {
+        error = L"Damaged block map";
+        return false;
+    }
+    std::vector<uint8_t> data((size_t)count * bytes);
+    if (!file.read((char*)data.data(), (std::streamsize)data.size())) {
+        error = L"Damaged block map";
+        return false;
+    }
+    checksums.resize((size_t)count);
+    for (size_t i = 0; i < checksums.size(); i++) {
+        checksums[i] = GetLittleEndian(&data[i * bytes], bytes);
+    }
+    return true;
+}
+
+bool IsBlockMap(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(Magic)];
+    return file.read(magic, sizeof(magic)) && memcmp(magic, Magic, sizeof(Magic)) == 0;
+}
+
+std::vector<ByteRange> DiffBlockMaps(const BlockMap& a, const BlockMap& b) {
+    std::vector<ByteRange> ranges;
+    auto add = [&](uint64_t offset, uint64_t end) {
+        if (!ranges.empty() && ranges.back().end == offset) {
+            ranges.back().end = end;
+        } else {
+            ranges.push_back({ offset, end });
+        }
+    };
+
+    uint64_t common = std::min(a.size, b.size);
+    size_t blocks = std::min(a.checksums.size(), b.checksums.size());
+    for (size_t i = 0; i < blocks; i++) {
+        uint64_t offset = i * a.blockSize;
+        uint64_t end = std::min(offset + a.blockSize, common);
+        // a short last block of one file differs from the full block of the other even if it matches as far as it goes
+        bool sameLength = std::min(offset + a.blockSize, a.size) == std::min(offset + b.blockSize, b.size);
+        if (a.checksums[i] != b.checksums[i] || !sameLength) {
+            add(offset, end);
+        }
+    }
+    if (a.size != b.size) {
+        add(common, std::max(a.size, b.size));
+    }
+    return ranges;
+}
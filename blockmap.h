@@ -0,0 +1,45 @@
+#pragma once
+
+// Block maps: the checksum of every fixed-size block of a file, recorded while the file is
+// hashed anyway. The whole-file checksum is combined from them, and comparing the maps of
+// two versions of a huge file shows where they differ without reading either again.
+
+#include "checksum.h"
+
+#include <stdint.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/// block size of the maps equals-cli writes
+constexpr uint64_t DefaultBlockSize = 1024 * 1024;
+
+struct BlockMap {
+    ChecksumType type = ChecksumType::Crc32;
+    uint64_t blockSize = DefaultBlockSize;
+    /// file size, the last block is shorter unless it is a multiple of blockSize
+    uint64_t size = 0;
+    std::vector<uint64_t> checksums;
+
+    /// checksum of the whole file, combined from the blocks
+    uint64_t Checksum() const;
+
+    /// little-endian binary file with 4 byte checksums for the 32 bit types, 8 byte ones for CRC64
+    bool Save(const std::filesystem::path& path) const;
+
+    /// false with error set if path isn't a block map or is damaged
+    bool Load(const std::filesystem::path& path, std::wstring& error);
+};
+
+/// whether path starts like a block map file, damaged or not
+bool IsBlockMap(const std::filesystem::path& path);
+
+/// byte range [offset, end)
+struct ByteRange {
+    uint64_t offset;
+    uint64_t end;
+};
+
+/// ranges whose blocks differ, adjacent blocks merged into one range; past the end of the
+/// shorter file everything differs. The maps need the same checksum type and block size.
+std::vector<ByteRange> DiffBlockMaps(const BlockMap& a, const BlockMap& b);
@@ -0,0 +1,209 @@
+#include "bufferpool.h"
+#include "numa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+/// a buffer, once allocated it stays with the pool for the life of the process
+struct Slot {
+    uint8_t* data = nullptr;
+    /// index + 1 of the slot below this one on its free stack, 0 at the bottom
+    std::atomic<uint32_t> next{ 0 };
+};
+
+/// Treiber stack of slot indices; the upper half of head counts the pushes and pops,
+/// so a slot that was popped and pushed again in between doesn't fool compare_exchange (ABA)
+struct FreeStack {
+    void Push(Slot* slots, uint32_t index) {
+        uint64_t head = top.load(std::memory_order_relaxed);
+        do {
+            slots[index].next.store((uint32_t)head, std::memory_order_relaxed);
+        } while (!top.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | (index + 1),
+            std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    /// false if the stack is empty
+    bool Pop(Slot* slots, uint32_t& index) {
+        uint64_t head = top.load(std::memory_order_acquire);
+        while ((uint32_t)head) {
+            uint32_t below = slots[(uint32_t)head - 1].next.load(std::memory_order_relaxed);
+            if (top.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | below,
+                std::memory_order_acquire, std::memory_order_acquire)) {
+                index = (uint32_t)head - 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::atomic<uint64_t> top{ 0 };
+};
+
+struct Pool {
+    /// the slots are created at the first Acquire, settings can't change after that
+    void Start() {
+        capacity = (uint32_t)std::clamp<uint64_t>(maxMemory / PoolBufferSize, 1, MaxBufferPoolMemory / PoolBufferSize);
+        // should even that table not fit into memory, a smaller pool does as well
+        while (!slots) {
+            slots.reset(new (std::nothrow) Slot[capacity]);
+            if (!slots) {
+                if (capacity == 1) {
+                    throw std::bad_alloc();
+                }
+                capacity /= 2;
+            }
+        }
+        stacks.reset(new FreeStack[NumaNodeCount()]);
+    }
+
+    uint32_t Acquire() {
+        std::call_once(started, [this]() { Start(); });
+        int nodes = NumaNodeCount();
+        int home = std::min(CurrentNumaNode(), nodes - 1);
+        for (int attempt = 0; ; attempt++) {
+            uint32_t index;
+            // a buffer that was first touched on this thread's node, then a new one, then any
+            if (stacks[home].Pop(slots.get(), index)) {
+                return index;
+            }
+            uint32_t count = allocated.load(std::memory_order_relaxed);
+            while (count < capacity) {
+                if (allocated.compare_exchange_weak(count, count + 1, std::memory_order_relaxed)) {
+                    // zero-filled pages from the system are placed when this thread first writes them
+                    slots[count].data = Allocate();
+                    return count;
+                }
+            }
+            for (int k = 1; k < nodes; k++) {
+                if (stacks[(home + k) % nodes].Pop(slots.get(), index)) {
+                    return index;
+                }
+            }
+            // all buffers are in use: the cap is reached
+            if (attempt < 16) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    void Release(uint32_t index) {
+        int home = std::min(CurrentNumaNode(), NumaNodeCount() - 1);
+        stacks[home].Push(slots.get(), index);
+    }
+
+    uint8_t* Allocate() {
+#ifdef _WIN32
+        if (hugePages) {
+            SIZE_T large = GetLargePageMinimum();
+            if (large && PoolBufferSize % large == 0) {
+                void* memory = VirtualAlloc(NULL, PoolBufferSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+                if (memory) {
+                    hugeCount++;
+                    return (uint8_t*)memory;
+                }
+            }
+        }
+        void* memory = VirtualAlloc(NULL, PoolBufferSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        return (uint8_t*)memory;
+#else
+#ifdef MAP_HUGETLB
+        if (hugePages) {
+            // only works if the administrator set aside huge pages (vm.nr_hugepages)
+            void* memory = mmap(nullptr, PoolBufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED) {
+                hugeCount++;
+                return (uint8_t*)memory;
+            }
+        }
+#endif
+        // over-allocate so the buffer can start on a huge page boundary, transparent huge pages need that
+        size_t mapped = hugePages ? 2 * PoolBufferSize : PoolBufferSize;
+        void* memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        uint8_t* data = (uint8_t*)memory;
+        if (hugePages) {
+            uintptr_t start = ((uintptr_t)memory + PoolBufferSize - 1) & ~(uintptr_t)(PoolBufferSize - 1);
+            data = (uint8_t*)start;
+            if (data > (uint8_t*)memory) {
+                munmap(memory, (size_t)(data - (uint8_t*)memory));
+            }
+            size_t tail = (size_t)((uint8_t*)memory + mapped - (data + PoolBufferSize));
+            if (tail) {
+                munmap(data + PoolBufferSize, tail);
+            }
+#ifdef MADV_HUGEPAGE
+            madvise(data, PoolBufferSize, MADV_HUGEPAGE);
+#endif
+        }
+        return data;
+#endif
+    }
+
+    uint64_t maxMemory = DefaultBufferPoolMemory;
+    bool hugePages = false;
+
+    std::once_flag started;
+    uint32_t capacity = 0;
+    std::unique_ptr<Slot[]> slots;
+    /// one free stack per NUMA node
+    std::unique_ptr<FreeStack[]> stacks;
+    std::atomic<uint32_t> allocated{ 0 };
+    std::atomic<uint32_t> hugeCount{ 0 };
+};
+
+/// never destroyed, detached GUI threads may still hold buffers while the process exits
+Pool& GetPool() {
+    static Pool* pool = new Pool;
+    return *pool;
+}
+
+std::atomic<bool> inUse{ false };
+
+} // anonymous namespace
+
+bool ConfigureBufferPool(uint64_t maxMemory, bool hugePages) {
+    if (inUse.load()) {
+        return false;
+    }
+    Pool& pool = GetPool();
+    pool.maxMemory = maxMemory;
+    pool.hugePages = hugePages;
+    return true;
+}
+
+PooledBuffer::PooledBuffer() {
+    inUse.store(true);
+    Pool& pool = GetPool();
+    slot = pool.Acquire();
+    data = pool.slots[slot].data;
+}
+
+PooledBuffer::~PooledBuffer() {
+    GetPool().Release(slot);
+}
+
+BufferPoolStatistics GetBufferPoolStatistics() {
+    Pool& pool = GetPool();
+    return { pool.allocated.load(), pool.hugeCount.load() };
+}
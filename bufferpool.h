@@ -0,0 +1,49 @@
+#pragma once
+
+// Process-wide pool of read buffers. Every worker used to allocate its own buffer, and
+// the GUI's hashing threads live for one file each, so every file paid for fresh pages:
+// page faults on the first read and TLB misses after. Pooled buffers are page-aligned,
+// one 2 MiB huge page each where the system gives them out, and are reused without locks.
+// Each NUMA node keeps its own buffers, so a bound worker gets node-local memory back.
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// size of every pooled buffer, one x86 huge page
+constexpr size_t PoolBufferSize = 2 * 1024 * 1024;
+
+/// default cap on the memory of all pooled buffers together
+constexpr uint64_t DefaultBufferPoolMemory = 1024ull * 1024 * 1024;
+
+/// largest cap accepted, 1 TiB; the pool keeps a slot for every buffer it may ever hold
+constexpr uint64_t MaxBufferPoolMemory = 1024ull * 1024 * 1024 * 1024;
+
+/// settings of the pool, only possible before the first buffer is acquired; false afterwards.
+/// maxMemory is clamped to MaxBufferPoolMemory.
+/// hugePages asks for MAP_HUGETLB pages (large pages on Windows, which needs the "Lock pages
+/// in memory" privilege), falling back to transparent huge pages and then to normal ones.
+bool ConfigureBufferPool(uint64_t maxMemory, bool hugePages);
+
+/// a buffer of PoolBufferSize bytes borrowed from the pool, given back when it goes out of scope;
+/// once the cap is reached, acquiring waits for another thread to give one back
+struct PooledBuffer {
+    PooledBuffer();
+    ~PooledBuffer();
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    uint8_t* data;
+    static constexpr size_t size = PoolBufferSize;
+
+private:
+    uint32_t slot;
+};
+
+/// buffers allocated so far, and how many of them are huge pages
+struct BufferPoolStatistics {
+    uint32_t buffers;
+    uint32_t hugePages;
+};
+
+BufferPoolStatistics GetBufferPoolStatistics();
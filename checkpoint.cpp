@@ -0,0 +1,203 @@
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+const wchar_t* const CancelledError = L"Cancelled";
+
+namespace {
+
+std::atomic<bool> checkpointsEnabled{ true };
+
+std::filesystem::path CheckpointDirectory() {
+#ifdef _WIN32
+    const wchar_t* localAppData = _wgetenv(L"LOCALAPPDATA");
+    return localAppData ? std::filesystem::path(localAppData) / L"equals" / L"checkpoints" : std::filesystem::path();
+#else
+    const char* cache = getenv("XDG_CACHE_HOME");
+    if (cache && *cache) {
+        return std::filesystem::path(cache) / "equals" / "checkpoints";
+    }
+    const char* home = getenv("HOME");
+    return home ? std::filesystem::path(home) / ".cache" / "equals" / "checkpoints" : std::filesystem::path();
+#endif
+}
+
+/// the narrow checksum name goes into the file, so a checkpoint of one type is never taken for another
+std::string TypeName(ChecksumType type) {
+    std::string name;
+    for (const wchar_t* c = ChecksumName(type); *c; c++) {
+        name.push_back((char)*c);
+    }
+    return name;
+}
+
+/// FNV-1a of the identity and type names the checkpoint file; both are checked again on loading
+std::filesystem::path CheckpointPath(const std::string& identity, ChecksumType type) {
+    std::filesystem::path directory = CheckpointDirectory();
+    if (directory.empty()) {
+        return directory;
+    }
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (char c : identity + " " + TypeName(type)) {
+        hash = (hash ^ (uint8_t)c) * 0x100000001B3ull;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.checkpoint", (unsigned long long)hash);
+    return directory / name;
+}
+
+const char* const Magic = "equals-checkpoint 1";
+
+} // anonymous namespace
+
+std::string FileIdentity(const std::filesystem::path& path) {
+    char identity[128];
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return std::string();
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL found = GetFileInformationByHandle(file, &info);
+    CloseHandle(file);
+    if (!found) {
+        return std::string();
+    }
+    snprintf(identity, sizeof(identity), "%08lx-%08lx%08lx %llu %08lx%08lx",
+        (unsigned long)info.dwVolumeSerialNumber, (unsigned long)info.nFileIndexHigh, (unsigned long)info.nFileIndexLow,
+        (unsigned long long)info.nFileSizeHigh << 32 | info.nFileSizeLow,
+        (unsigned long)info.ftLastWriteTime.dwHighDateTime, (unsigned long)info.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return std::string();
+    }
+#ifdef __APPLE__
+    long long seconds = (long long)info.st_mtimespec.tv_sec, nanoseconds = (long long)info.st_mtimespec.tv_nsec;
+#else
+    long long seconds = (long long)info.st_mtim.tv_sec, nanoseconds = (long long)info.st_mtim.tv_nsec;
+#endif
+    snprintf(identity, sizeof(identity), "%llx-%llx %llu %lld.%09lld",
+        (unsigned long long)info.st_dev, (unsigned long long)info.st_ino, (unsigned long long)info.st_size, seconds, nanoseconds);
+#endif
+    return identity;
+}
+
+bool LoadCheckpoint(const std::string& identity, ChecksumType type, HashCheckpoint& checkpoint) {
+    if (!checkpointsEnabled.load() || identity.empty()) {
+        return false;
+    }
+    std::ifstream file(CheckpointPath(identity, type));
+    std::string magic, savedIdentity, savedType;
+    if (!std::getline(file, magic) || magic != Magic || !std::getline(file, savedIdentity) || !std::getline(file, savedType)) {
+        return false;
+    }
+    // another file whose identity happened to hash to the same name
+    if (savedIdentity != identity || savedType != TypeName(type)) {
+        return false;
+    }
+    HashCheckpoint loaded;
+    if (!(file >> loaded.offset >> loaded.checksum)) {
+        return false;
+    }
+    checkpoint = loaded;
+    return true;
+}
+
+bool SaveCheckpoint(const std::string& identity, ChecksumType type, const HashCheckpoint& checkpoint) {
+    if (!checkpointsEnabled.load() || identity.empty()) {
+        return false;
+    }
+    std::filesystem::path path = CheckpointPath(identity, type);
+    if (path.empty()) {
+        return false;
+    }
+    std::error_code ec{};
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    // written next to it and renamed over it, a crash while writing leaves the previous checkpoint
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        file << Magic << '\n' << identity << '\n' << TypeName(type) << '\n'
+            << checkpoint.offset << ' ' << checkpoint.checksum << '\n';
+        if (!file.flush()) {
+            return false;
+        }
+    }
+    std::filesystem::rename(temporary, path, ec);
+    return !ec;
+}
+
+void RemoveCheckpoint(const std::string& identity, ChecksumType type) {
+    if (identity.empty()) {
+        return;
+    }
+    std::filesystem::path path = CheckpointPath(identity, type);
+    if (!path.empty()) {
+        std::error_code ec{};
+        std::filesystem::remove(path, ec);
+    }
+}
+
+void EnableCheckpoints(bool enabled) {
+    checkpointsEnabled = enabled;
+}
+
+bool CheckpointsEnabled() {
+    return checkpointsEnabled.load();
+}
+
+void HashControl::Pause() {
+    std::lock_guard<std::mutex> lock(mtx);
+    paused = true;
+    interrupted = true;
+}
+
+void HashControl::Resume() {
+    std::lock_guard<std::mutex> lock(mtx);
+    paused = false;
+    interrupted = cancelled;
+    changed.notify_all();
+}
+
+void HashControl::Cancel() {
+    std::lock_guard<std::mutex> lock(mtx);
+    cancelled = true;
+    interrupted = true;
+    changed.notify_all();
+}
+
+bool HashControl::WaitWhilePaused() {
+    std::unique_lock<std::mutex> lock(mtx);
+    changed.wait(lock, [this]() { return !paused || cancelled; });
+    return !cancelled;
+}
+
+bool HashControl::Cancelled() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return cancelled;
+}
+
+void HashControl::Finish() {
+    std::lock_guard<std::mutex> lock(mtx);
+    finished = true;
+    changed.notify_all();
+}
+
+bool HashControl::WaitFinished(double seconds) {
+    std::unique_lock<std::mutex> lock(mtx);
+    return changed.wait_for(lock, std::chrono::duration<double>(seconds), [this]() { return finished; });
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+// Resuming the checksum of a huge file. While a file of CheckpointFileSize or more is hashed,
+// the offset reached and the checksum up to it are saved every few seconds, under a name
+// derived from the file's identity (device, file number, size and modification time) and the
+// checksum type. If the process ends before the file is done, the next attempt continues the
+// checksum from there instead of from byte 0; a file that changed in between has another
+// identity and starts over. Pausing and cancelling through a HashControl save a checkpoint too.
+
+#include "checksum.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+
+/// files smaller than this are hashed again from the start, it doesn't take long
+constexpr uint64_t CheckpointFileSize = 1024ull * 1024 * 1024;
+
+/// seconds between two checkpoints of the same file
+constexpr double CheckpointSeconds = 10;
+
+struct HashCheckpoint {
+    /// bytes hashed, the checksum covers [0, offset)
+    uint64_t offset = 0;
+    uint64_t checksum = 0;
+};
+
+/// device, file number, size and modification time of path, empty if it can't be looked at
+std::string FileIdentity(const std::filesystem::path& path);
+
+/// the last checkpoint of the file with this identity, false if there is none
+bool LoadCheckpoint(const std::string& identity, ChecksumType type, HashCheckpoint& checkpoint);
+
+/// replace the file's checkpoint, false if it can't be written
+bool SaveCheckpoint(const std::string& identity, ChecksumType type, const HashCheckpoint& checkpoint);
+
+/// forget the checkpoint once the file is done
+void RemoveCheckpoint(const std::string& identity, ChecksumType type);
+
+/// checkpoints are written and used unless switched off
+void EnableCheckpoints(bool enabled);
+bool CheckpointsEnabled();
+
+/// pause, resume and cancel a HashFile running on another thread; HashFile checks it between reads
+struct HashControl {
+    void Pause();
+    void Resume();
+    /// HashFile returns with the error Cancelled, resuming from its checkpoint the next time
+    void Cancel();
+
+    /// whether HashFile has to save a checkpoint and call WaitWhilePaused
+    bool Interrupted() const {
+        return interrupted.load(std::memory_order_relaxed);
+    }
+
+    /// blocks while paused, false once cancelled
+    bool WaitWhilePaused();
+
+    bool Cancelled();
+
+    /// the thread running HashFile is done with the control
+    void Finish();
+
+    /// wait up to seconds for Finish, false if it didn't come
+    bool WaitFinished(double seconds);
+
+private:
+    std::mutex mtx;
+    std::condition_variable changed;
+    std::atomic<bool> interrupted{ false };
+    bool paused = false;
+    bool cancelled = false;
+    bool finished = false;
+};
+
+/// error of a HashFile that was cancelled
+extern const wchar_t* const CancelledError;
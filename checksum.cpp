@@ -0,0 +1,185 @@
+#include "checksum.h"
+#include "crc32.h"
+#include "crc64.h"
+#include "crcengine.h"
+
+#include <string.h>
+#include <cwctype>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define CHECKSUM_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+const wchar_t* ChecksumName(ChecksumType type) {
+    switch (type) {
+    case ChecksumType::Crc32: return L"CRC32";
+    case ChecksumType::Crc32c: return L"CRC32C";
+    case ChecksumType::Crc64: return L"CRC64";
+    }
+    return L"?";
+}
+
+bool ParseChecksumType(const std::wstring& name, ChecksumType& type) {
+    std::wstring upper;
+    for (wchar_t c : name) {
+        upper.push_back((wchar_t)std::towupper(c));
+    }
+
+    for (ChecksumType candidate : ChecksumTypes) {
+        if (upper == ChecksumName(candidate)) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+int ChecksumDigits(ChecksumType type) {
+    return type == ChecksumType::Crc64 ? 16 : 8;
+}
+
+uint64_t UpdateChecksum(ChecksumType type, const void* data, size_t length, uint64_t previous) {
+    switch (type) {
+    case ChecksumType::Crc32: return crc32_fast(data, length, (uint32_t)previous);
+    case ChecksumType::Crc32c: return crc32c_fast(data, length, (uint32_t)previous);
+    case ChecksumType::Crc64: return crc64_fast(data, length, previous);
+    }
+    return 0;
+}
+
+uint64_t CombineChecksums(ChecksumType type, uint64_t checksumA, uint64_t checksumB, uint64_t lengthB) {
+    switch (type) {
+    case ChecksumType::Crc32: return crc32_combine((uint32_t)checksumA, (uint32_t)checksumB, (size_t)lengthB);
+    case ChecksumType::Crc32c: return crc32c_combine((uint32_t)checksumA, (uint32_t)checksumB, (size_t)lengthB);
+    case ChecksumType::Crc64: return crc64_combine(checksumA, checksumB, lengthB);
+    }
+    return 0;
+}
+
+namespace {
+
+/// the operator that appends one zero byte raised to every power of two,
+/// column i of a matrix is the image of register bit i
+template <typename Engine>
+struct ZeroOperators {
+    using Value = typename Engine::Value;
+
+    ZeroOperators() {
+        for (int i = 0; i < Engine::Bits; i++) {
+            power[0][i] = Engine::ShiftZeros((Value)1 << i, 1);
+        }
+        for (int k = 1; k < 64; k++) {
+            for (int i = 0; i < Engine::Bits; i++) {
+                power[k][i] = Apply(power[k - 1], power[k - 1][i]);
+            }
+        }
+    }
+
+    static Value Apply(const Value* op, Value value) {
+        Value result = 0;
+        for (int i = 0; value; i++, value >>= 1) {
+            if (value & 1) {
+                result ^= op[i];
+            }
+        }
+        return result;
+    }
+
+    /// one matrix-vector product per set bit of length
+    Value Shift(Value reg, uint64_t length) const {
+        for (int k = 0; length; k++, length >>= 1) {
+            if (length & 1) {
+                reg = Apply(power[k], reg);
+            }
+        }
+        return reg;
+    }
+
+    static const ZeroOperators& Get() {
+        static const ZeroOperators operators;
+        return operators;
+    }
+
+    Value power[64][Engine::Bits];
+};
+
+/// the register holds the inverted checksum, zeros only shift it
+template <typename Engine>
+uint64_t ExtendWithZeros(uint64_t previous, uint64_t length) {
+    typename Engine::Value reg = ~(typename Engine::Value)previous & Engine::Mask;
+    return ~ZeroOperators<Engine>::Get().Shift(reg, length) & Engine::Mask;
+}
+
+/// UpdateChecksumSkipZeros looks at blocks of this size
+const size_t ZeroBlockSize = 4096;
+
+/// whether length bytes (a multiple of 64) are all zero, stops at the first 64 bytes that aren't
+bool IsZeroBlock(const uint8_t* data, size_t length) {
+#ifdef CHECKSUM_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t i = 0; i < length; i += 64) {
+        __m128i any = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(data + i)), _mm_loadu_si128((const __m128i*)(data + i + 16))),
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(data + i + 32)), _mm_loadu_si128((const __m128i*)(data + i + 48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+#else
+    for (size_t i = 0; i < length; i += 64) {
+        uint64_t words[8];
+        memcpy(words, data + i, sizeof(words));
+        if (words[0] | words[1] | words[2] | words[3] | words[4] | words[5] | words[6] | words[7]) {
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+} // anonymous namespace
+
+uint64_t ExtendChecksum(ChecksumType type, uint64_t previous, uint64_t length) {
+    switch (type) {
+    case ChecksumType::Crc32: return ExtendWithZeros<Crc32Engine>(previous, length);
+    case ChecksumType::Crc32c: return ExtendWithZeros<Crc32cEngine>(previous, length);
+    case ChecksumType::Crc64: return ExtendWithZeros<Crc64Engine>(previous, length);
+    }
+    return 0;
+}
+
+bool IsAllZeros(const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    size_t whole = length - length % 64;
+    if (!IsZeroBlock(bytes, whole)) {
+        return false;
+    }
+    for (size_t i = whole; i < length; i++) {
+        if (bytes[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t UpdateChecksumSkipZeros(ChecksumType type, const void* data, size_t length, uint64_t previous) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    // bytes before hashed are already in previous
+    size_t hashed = 0;
+    size_t offset = 0;
+    while (offset + ZeroBlockSize <= length) {
+        if (!IsZeroBlock(bytes + offset, ZeroBlockSize)) {
+            offset += ZeroBlockSize;
+            continue;
+        }
+        size_t end = offset + ZeroBlockSize;
+        while (end + ZeroBlockSize <= length && IsZeroBlock(bytes + end, ZeroBlockSize)) {
+            end += ZeroBlockSize;
+        }
+        previous = UpdateChecksum(type, bytes + hashed, offset - hashed, previous);
+        previous = ExtendChecksum(type, previous, end - offset);
+        hashed = offset = end;
+    }
+    return UpdateChecksum(type, bytes + hashed, length - hashed, previous);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/// checksum algorithms files can be compared with
+enum class ChecksumType {
+    Crc32,  // zlib polynomial, also used by ZIP, PNG and Ethernet
+    Crc32c, // Castagnoli polynomial, also used by iSCSI, ext4 and RocksDB
+    Crc64,  // ECMA-182 polynomial as in xz, for scans too large for 32 bit collision odds
+};
+
+/// every checksum type, in menu order
+constexpr ChecksumType ChecksumTypes[] = { ChecksumType::Crc32, ChecksumType::Crc32c, ChecksumType::Crc64 };
+
+/// display name such as L"CRC32"
+const wchar_t* ChecksumName(ChecksumType type);
+
+/// accepts the display names, case insensitive
+bool ParseChecksumType(const std::wstring& name, ChecksumType& type);
+
+/// number of hex digits needed to print a checksum
+int ChecksumDigits(ChecksumType type);
+
+/// continue a checksum over more data, previous is 0 for the first block
+uint64_t UpdateChecksum(ChecksumType type, const void* data, size_t length, uint64_t previous);
+
+/// checksum of A followed by B, from the checksums of A and B and the length of B
+uint64_t CombineChecksums(ChecksumType type, uint64_t checksumA, uint64_t checksumB, uint64_t lengthB);
+
+/// continue a checksum over length zero bytes without reading them, in O(log length) steps
+uint64_t ExtendChecksum(ChecksumType type, uint64_t previous, uint64_t length);
+
+/// whether all length bytes are zero, stops soon after the first one that isn't
+bool IsAllZeros(const void* data, size_t length);
+
+/// same result as UpdateChecksum, but runs of all-zero 4 KiB blocks are skipped with ExtendChecksum
+/// instead of being hashed; checking a block that holds data costs about one cache line
+uint64_t UpdateChecksumSkipZeros(ChecksumType type, const void* data, size_t length, uint64_t previous);
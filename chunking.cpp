@@ -0,0 +1,218 @@
+#include "chunking.h"
+#include "bufferpool.h"
+
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+
+namespace {
+
+/// one random 64 bit value per byte value, from splitmix64 so chunks are the same on every build
+struct GearTable {
+    constexpr GearTable() : value() {
+        uint64_t state = 0;
+        for (int i = 0; i < 256; i++) {
+            state += 0x9E3779B97F4A7C15ull;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            value[i] = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t value[256];
+};
+
+constexpr GearTable Gear;
+
+// Each byte shifts the hash left by one, so after 64 bytes a byte has left it again and
+// bit k only depends on the last k + 1 bytes: the patterns test the top bits.
+// 15 bits (one cut in 32 KiB) before NormalChunkSize, 11 bits (one in 2 KiB) after it.
+constexpr uint64_t HardMask = ~0ull << 49;
+constexpr uint64_t EasyMask = ~0ull << 53;
+
+/// candidates are cut positions in the buffer, the top bit set if the hash matched HardMask too
+constexpr uint32_t Hard = 0x80000000u;
+
+/// every position after which the hash of the preceding 64 bytes matches EasyMask, in order.
+/// The hash only depends on those 64 bytes, so the buffer is split into lanes that are hashed
+/// in one loop, each starting 64 bytes early: four independent dependency chains instead of one.
+void FindCandidates(const uint8_t* data, size_t length, std::vector<uint32_t>& candidates) {
+    const size_t Lanes = 4;
+    thread_local std::vector<uint32_t> lanes[Lanes];
+    size_t span = length / Lanes;
+    uint64_t hash[Lanes];
+    for (size_t lane = 0; lane < Lanes; lane++) {
+        hash[lane] = 0;
+        for (size_t i = lane * span - std::min<size_t>(lane * span, 64); i < lane * span; i++) {
+            hash[lane] = (hash[lane] << 1) + Gear.value[data[i]];
+        }
+        lanes[lane].clear();
+    }
+
+    // the hashes stay in registers, candidates are rare enough for the branches to be predicted
+    uint64_t h0 = hash[0], h1 = hash[1], h2 = hash[2], h3 = hash[3];
+    const uint8_t* p0 = data;
+    const uint8_t* p1 = data + span;
+    const uint8_t* p2 = data + 2 * span;
+    const uint8_t* p3 = data + 3 * span;
+    auto found = [&](size_t lane, size_t i, uint64_t h) {
+        lanes[lane].push_back((uint32_t)(i + 1) | (h & HardMask ? 0 : Hard));
+    };
+    for (size_t i = 0; i < span; i++) {
+        h0 = (h0 << 1) + Gear.value[p0[i]];
+        h1 = (h1 << 1) + Gear.value[p1[i]];
+        h2 = (h2 << 1) + Gear.value[p2[i]];
+        h3 = (h3 << 1) + Gear.value[p3[i]];
+        if (!(h0 & EasyMask)) {
+            found(0, i, h0);
+        }
+        if (!(h1 & EasyMask)) {
+            found(1, span + i, h1);
+        }
+        if (!(h2 & EasyMask)) {
+            found(2, 2 * span + i, h2);
+        }
+        if (!(h3 & EasyMask)) {
+            found(3, 3 * span + i, h3);
+        }
+    }
+    // the last lane takes the remainder
+    for (size_t i = Lanes * span; i < length; i++) {
+        h3 = (h3 << 1) + Gear.value[data[i]];
+        if (!(h3 & EasyMask)) {
+            found(3, i, h3);
+        }
+    }
+
+    candidates.clear();
+    for (const std::vector<uint32_t>& lane : lanes) {
+        candidates.insert(candidates.end(), lane.begin(), lane.end());
+    }
+}
+
+/// end of the chunk that starts at start, data being available up to end;
+/// next is the first candidate not yet passed and moves along
+size_t NextCut(const std::vector<uint32_t>& candidates, size_t& next, size_t start, size_t end) {
+    size_t limit = std::min(start + MaxChunkSize, end);
+    while (next < candidates.size() && (candidates[next] & ~Hard) < start + MinChunkSize) {
+        next++;
+    }
+    for (size_t i = next; i < candidates.size() && (candidates[i] & ~Hard) <= limit; i++) {
+        size_t position = candidates[i] & ~Hard;
+        if ((candidates[i] & Hard) || position >= start + NormalChunkSize) {
+            return position;
+        }
+    }
+    return limit;
+}
+
+} // anonymous namespace
+
+bool ChunkFile(const std::filesystem::path& path, ChecksumType type, std::vector<FileChunk>& chunks, std::wstring& error) {
+    chunks.clear();
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = L"Failed to open file";
+        return false;
+    }
+
+    // the unfinished last chunk of each read moves to the front for the next one
+    PooledBuffer buffer;
+    thread_local std::vector<uint32_t> candidates;
+    size_t filled = 0;
+    bool eof = false;
+    while (!eof) {
+        file.read((char*)buffer.data + filled, (std::streamsize)(buffer.size - filled));
+        if (file.bad()) {
+            error = L"Failed to read file";
+            return false;
+        }
+        filled += (size_t)file.gcount();
+        eof = !file;
+
+        FindCandidates(buffer.data, filled, candidates);
+        size_t start = 0;
+        size_t next = 0;
+        while (start < filled && (eof || filled - start >= MaxChunkSize)) {
+            size_t cut = NextCut(candidates, next, start, filled);
+            FileChunk chunk;
+            chunk.crc = UpdateChecksumSkipZeros(type, buffer.data + start, cut - start, 0);
+            chunk.length = (uint32_t)(cut - start);
+            chunks.push_back(chunk);
+            start = cut;
+        }
+        memmove(buffer.data, buffer.data + start, filled - start);
+        filled -= start;
+    }
+    return true;
+}
+
+std::vector<ChunkOverlap> FindOverlaps(const std::vector<std::vector<FileChunk>>& files) {
+    // all chunks sorted by content, then by file
+    struct Entry {
+        uint64_t crc;
+        uint32_t length;
+        uint32_t file;
+    };
+    std::vector<Entry> entries;
+    size_t total = 0;
+    for (const std::vector<FileChunk>& chunks : files) {
+        total += chunks.size();
+    }
+    entries.reserve(total);
+    for (size_t file = 0; file < files.size(); file++) {
+        for (const FileChunk& chunk : files[file]) {
+            entries.push_back({ chunk.crc, chunk.length, (uint32_t)file });
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        if (a.crc != b.crc) {
+            return a.crc < b.crc;
+        }
+        if (a.length != b.length) {
+            return a.length < b.length;
+        }
+        return a.file < b.file;
+    });
+
+    // a chunk found in n files adds its bytes to each of their n * (n - 1) / 2 pairs
+    struct Shared {
+        uint64_t a = 0;
+        uint64_t b = 0;
+    };
+    std::unordered_map<uint64_t, Shared> pairs;
+    struct Holder {
+        uint32_t file;
+        uint64_t bytes;
+    };
+    std::vector<Holder> holders;
+    for (size_t begin = 0, end; begin < entries.size(); begin = end) {
+        holders.clear();
+        for (end = begin; end < entries.size() && entries[end].crc == entries[begin].crc && entries[end].length == entries[begin].length; end++) {
+            if (holders.empty() || holders.back().file != entries[end].file) {
+                holders.push_back({ entries[end].file, 0 });
+            }
+            // repeated within a file, every copy is shared
+            holders.back().bytes += entries[end].length;
+        }
+        for (size_t i = 0; i < holders.size(); i++) {
+            for (size_t j = i + 1; j < holders.size(); j++) {
+                Shared& shared = pairs[(uint64_t)holders[i].file << 32 | holders[j].file];
+                shared.a += holders[i].bytes;
+                shared.b += holders[j].bytes;
+            }
+        }
+    }
+
+    std::vector<ChunkOverlap> overlaps;
+    overlaps.reserve(pairs.size());
+    for (const auto& pair : pairs) {
+        overlaps.push_back({ (size_t)(pair.first >> 32), (size_t)(uint32_t)pair.first, pair.second.a, pair.second.b });
+    }
+    std::sort(overlaps.begin(), overlaps.end(), [](const ChunkOverlap& a, const ChunkOverlap& b) {
+        return a.fileA != b.fileA ? a.fileA < b.fileA : a.fileB < b.fileB;
+    });
+    return overlaps;
+}
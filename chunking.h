@@ -0,0 +1,39 @@
+#pragma once
+
+// Content-defined chunking: files are cut where a rolling hash of the last 64 bytes hits a
+// pattern, so an insertion or deletion only moves the cuts next to it and two files that
+// differ in places still share most of their chunks. Comparing chunk checksums tells how
+// much of two near-duplicates (VM images, database dumps, rebuilt binaries) is the same.
+
+#include "checksum.h"
+
+#include <stdint.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/// chunks are cut at a gear hash boundary, FastCDC style: no cut before MinChunkSize,
+/// a harder pattern up to NormalChunkSize and an easier one after it, always a cut at MaxChunkSize
+constexpr uint32_t MinChunkSize = 2 * 1024;
+constexpr uint32_t NormalChunkSize = 8 * 1024;
+constexpr uint32_t MaxChunkSize = 64 * 1024;
+
+struct FileChunk {
+    uint64_t crc = 0;
+    uint32_t length = 0;
+};
+
+/// the file's chunks in order, with the checksum of each; false with error set if it can't be read
+bool ChunkFile(const std::filesystem::path& path, ChecksumType type, std::vector<FileChunk>& chunks, std::wstring& error);
+
+/// bytes two files have in common, counting the chunks of each that also occur in the other
+struct ChunkOverlap {
+    size_t fileA;
+    size_t fileB;
+    uint64_t sharedA;
+    uint64_t sharedB;
+};
+
+/// every pair of files with at least one chunk in common, ordered by fileA then fileB;
+/// chunks are told apart by checksum and length
+std::vector<ChunkOverlap> FindOverlaps(const std::vector<std::vector<FileChunk>>& files);
@@ -0,0 +1,529 @@
+// Console front end: prints "CHECKSUM SIZE PATH" for every file given on the command line,
+// directories are hashed recursively.
+
+#include "blockmap.h"
+#include "chunking.h"
+#include "copyfile.h"
+#include "diskorder.h"
+#include "duplicates.h"
+#include "filehash.h"
+#include "iotuning.h"
+#include "manifest.h"
+#include "numa.h"
+#include "options.h"
+#include "tararchive.h"
+#include "ziparchive.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/// canonical paths of all files, only the arguments and symbolic links need resolving:
+/// everything found below a canonical directory is canonical already;
+/// files and directories in excluded (canonical too) are left out, the outputs of this run
+std::vector<fs::path> CollectFiles(const std::vector<std::wstring>& paths, const std::vector<fs::path>& excluded) {
+    auto isExcluded = [&](const fs::path& path) {
+        return std::find(excluded.begin(), excluded.end(), path) != excluded.end();
+    };
+    std::vector<fs::path> files;
+    for (const std::wstring& path : paths) {
+        std::error_code ec{};
+        fs::path root = CanonicalPath(path);
+        if (isExcluded(root)) {
+            continue;
+        }
+        if (!fs::is_directory(root, ec)) {
+            files.push_back(root);
+            continue;
+        }
+        for (auto it = fs::recursive_directory_iterator(root, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (isExcluded(it->path())) {
+                it.disable_recursion_pending();
+            } else if (it->is_symlink(ec)) {
+                if (fs::is_regular_file(it->path(), ec)) {
+                    fs::path target = CanonicalPath(it->path());
+                    if (!isExcluded(target)) {
+                        files.push_back(target);
+                    }
+                }
+            } else if (it->is_regular_file(ec)) {
+                files.push_back(it->path());
+            }
+        }
+    }
+    return files;
+}
+
+/// the members of a tar archive streamed through once, a damaged archive adds a line of its own
+bool HashTarArchive(const fs::path& path, ChecksumType type, std::vector<std::string>& names, std::vector<FileHash>& hashes) {
+    std::vector<TarMember> members;
+    std::wstring error;
+    if (!HashTarMembers(path, type, members, error)) {
+        return false;
+    }
+    for (TarMember& member : members) {
+        names.push_back(path.u8string() + "/" + member.name);
+        hashes.push_back(std::move(member.hash));
+    }
+    if (!error.empty()) {
+        FileHash hash{};
+        hash.error = error;
+        names.push_back(path.u8string());
+        hashes.push_back(std::move(hash));
+    }
+    return true;
+}
+
+/// one output line per archive member, named ARCHIVE/MEMBER; false if path isn't a ZIP or tar archive
+bool HashArchive(const fs::path& path, ChecksumType type, bool verify, std::vector<std::string>& names, std::vector<FileHash>& hashes) {
+    std::vector<ZipMember> members;
+    std::wstring error;
+    if (!ReadZipDirectory(path, members, error)) {
+        return HashTarArchive(path, type, names, hashes);
+    }
+    std::vector<FileHash> verified;
+    if (verify) {
+        verified = HashZipMembers(path, members, type);
+    }
+    for (size_t i = 0; i < members.size(); i++) {
+        names.push_back(path.u8string() + "/" + members[i].name);
+        if (verify) {
+            hashes.push_back(std::move(verified[i]));
+        } else {
+            FileHash hash{};
+            hash.size = members[i].size;
+            hash.crc = members[i].crc;
+            hashes.push_back(hash);
+        }
+    }
+    return true;
+}
+
+/// --overlap: chunk every file, one at a time per thread, then compare all chunks at once
+int ReportOverlaps(const std::vector<fs::path>& files, ChecksumType checksum) {
+    std::vector<std::vector<FileChunk>> chunks(files.size());
+    std::vector<std::wstring> errors(files.size());
+    std::atomic<size_t> next{ 0 };
+    std::vector<std::thread> threads(std::max(1u, std::thread::hardware_concurrency()));
+    for (auto& thread : threads) {
+        thread = std::thread([&]() {
+            for (size_t i; (i = next++) < files.size(); ) {
+                ChunkFile(files[i], checksum, chunks[i], errors[i]);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bool failed = false;
+    std::vector<uint64_t> sizes(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!errors[i].empty()) {
+            fprintf(stderr, "%s: %ls\n", files[i].u8string().c_str(), errors[i].c_str());
+            failed = true;
+        }
+        for (const FileChunk& chunk : chunks[i]) {
+            sizes[i] += chunk.length;
+        }
+    }
+    for (const ChunkOverlap& overlap : FindOverlaps(chunks)) {
+        printf("%5.1f%% %5.1f%% %s %s\n",
+            100.0 * (double)overlap.sharedA / (double)sizes[overlap.fileA],
+            100.0 * (double)overlap.sharedB / (double)sizes[overlap.fileB],
+            files[overlap.fileA].u8string().c_str(), files[overlap.fileB].u8string().c_str());
+    }
+    return failed ? 1 : 0;
+}
+
+/// name of the block map of path below the --blockmaps directory: the whole path, its separators percent-encoded
+fs::path BlockMapPath(const fs::path& directory, const fs::path& path) {
+    std::string name;
+    for (char c : path.u8string()) {
+        if (c == '/' || c == '\\' || c == ':' || c == '%') {
+            char escaped[4];
+            snprintf(escaped, sizeof(escaped), "%%%02X", (unsigned char)c);
+            name += escaped;
+        } else {
+            name.push_back(c);
+        }
+    }
+    return directory / fs::u8path(name + ".blockmap");
+}
+
+/// --diff A B: one line "OFFSET LENGTH" per differing range; exit code 0 if equal, 1 if not, as cmp
+int ReportDifferences(const fs::path& pathA, const fs::path& pathB, std::optional<ChecksumType> checksum) {
+    // a file is hashed to match a saved map it is compared with
+    BlockMap maps[2];
+    const fs::path* paths[2] = { &pathA, &pathB };
+    bool saved[2] = { IsBlockMap(pathA), IsBlockMap(pathB) };
+    for (int i : { 0, 1 }) {
+        if (!saved[i]) {
+            continue;
+        }
+        std::wstring error;
+        if (!maps[i].Load(*paths[i], error)) {
+            fprintf(stderr, "%s: %ls\n", paths[i]->u8string().c_str(), error.c_str());
+            return 2;
+        }
+    }
+    for (int i : { 0, 1 }) {
+        if (saved[i]) {
+            continue;
+        }
+        ChecksumType type = saved[1 - i] ? maps[1 - i].type : checksum.value_or(ChecksumType::Crc32);
+        maps[i].blockSize = saved[1 - i] ? maps[1 - i].blockSize : DefaultBlockSize;
+        FileHash hash = HashFile(*paths[i], type, nullptr, nullptr, &maps[i]);
+        if (!hash.error.empty()) {
+            fprintf(stderr, "%s: %ls\n", paths[i]->u8string().c_str(), hash.error.c_str());
+            return 2;
+        }
+    }
+    if (maps[0].type != maps[1].type || maps[0].blockSize != maps[1].blockSize) {
+        fprintf(stderr, "The block maps differ in checksum or block size\n");
+        return 2;
+    }
+
+    std::vector<ByteRange> ranges = DiffBlockMaps(maps[0], maps[1]);
+    for (const ByteRange& range : ranges) {
+        printf("%llu %llu\n", (unsigned long long)range.offset, (unsigned long long)(range.end - range.offset));
+    }
+    return ranges.empty() ? 0 : 1;
+}
+
+/// --copy=DIR: every file to DIR/NAME, directories to DIR/NAME/..., several files at a time;
+/// prints "CHECKSUM SIZE COPY" for every copy that read back the same
+int CopyFiles(const std::vector<std::wstring>& paths, const fs::path& directory, ChecksumType checksum, ManifestWriter& manifest) {
+    std::vector<std::pair<fs::path, fs::path>> copies;
+    bool failed = false;
+    for (const std::wstring& path : paths) {
+        std::error_code ec{};
+        fs::path root = CanonicalPath(path);
+        fs::path target = directory / root.filename();
+        if (!fs::is_directory(root, ec)) {
+            copies.emplace_back(root, target);
+            continue;
+        }
+        for (auto it = fs::recursive_directory_iterator(root, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            fs::path copy = target / it->path().lexically_relative(root);
+            if (it->is_directory(ec)) {
+                fs::create_directories(copy, ec);
+            } else if (it->is_regular_file(ec)) {
+                copies.emplace_back(it->path(), copy);
+            }
+        }
+        ec.clear();
+        fs::create_directories(target, ec);
+    }
+    std::error_code ec{};
+    fs::create_directories(directory, ec);
+
+    std::mutex mtx;
+    std::atomic<size_t> next{ 0 };
+    std::vector<std::thread> threads(std::max(1u, std::thread::hardware_concurrency()));
+    for (auto& thread : threads) {
+        thread = std::thread([&]() {
+            for (size_t i; (i = next++) < copies.size(); ) {
+                FileHash hash = CopyAndVerify(copies[i].first, copies[i].second, checksum);
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!hash.error.empty()) {
+                    fprintf(stderr, "%s: %ls\n", copies[i].first.u8string().c_str(), hash.error.c_str());
+                    failed = true;
+                } else {
+                    printf("%0*llX %llu %s\n", ChecksumDigits(checksum), (unsigned long long)hash.crc,
+                        (unsigned long long)hash.size, copies[i].second.u8string().c_str());
+                    if (manifest.IsOpen()) {
+                        manifest.Add(copies[i].second, hash.crc);
+                    }
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return failed ? 1 : 0;
+}
+
+/// --verify=FILE: hash the files of the manifest in batches on all threads, a line for every
+/// file that differs as soon as it is known; exit code 0 if all match
+int VerifyManifest(const fs::path& path, std::optional<ChecksumType> checksum) {
+    Manifest manifest;
+    std::wstring error;
+    if (!manifest.Load(path, checksum, error)) {
+        fprintf(stderr, "%s: %ls\n", path.u8string().c_str(), error.c_str());
+        return 2;
+    }
+
+    const size_t Batch = 64;
+    std::mutex mtx;
+    std::atomic<size_t> next{ 0 };
+    size_t mismatched = 0, unreadable = 0;
+    std::vector<std::thread> threads(std::max(1u, std::thread::hardware_concurrency()));
+    for (auto& thread : threads) {
+        thread = std::thread([&]() {
+            std::vector<fs::path> paths;
+            for (size_t begin; (begin = next.fetch_add(Batch)) < manifest.entries.size(); ) {
+                size_t end = std::min(begin + Batch, manifest.entries.size());
+                paths.clear();
+                for (size_t i = begin; i < end; i++) {
+                    paths.push_back(manifest.Path(manifest.entries[i]));
+                }
+                std::vector<FileHash> hashes = HashFiles(paths, manifest.type);
+
+                std::lock_guard<std::mutex> lock(mtx);
+                for (size_t i = begin; i < end; i++) {
+                    const FileHash& hash = hashes[i - begin];
+                    std::string name(manifest.Name(manifest.entries[i]));
+                    if (!hash.error.empty()) {
+                        fprintf(stderr, "%s: %ls\n", name.c_str(), hash.error.c_str());
+                        unreadable++;
+                    } else if (hash.crc != manifest.entries[i].checksum) {
+                        printf("%s: FAILED\n", name.c_str());
+                        fflush(stdout);
+                        mismatched++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    fprintf(stderr, "%zu files checked, %zu differ, %zu unreadable\n", manifest.entries.size(), mismatched, unreadable);
+    return mismatched || unreadable ? 1 : 0;
+}
+
+/// results kept for --duplicates, sizes and checksums in arrays of their own as DuplicateIndex::Build takes them
+struct Results {
+    std::vector<std::string> names;
+    std::vector<uint64_t> sizes;
+    std::vector<uint64_t> checksums;
+};
+
+/// --duplicates: the groups of equal files, the most wasted bytes first, separated by blank lines
+void ReportDuplicates(const Results& results, ChecksumType checksum) {
+    DuplicateIndex index;
+    index.Build(results.sizes.data(), results.checksums.data(), results.names.size());
+    std::vector<uint32_t> classes;
+    std::vector<size_t> starts;
+    std::vector<uint32_t> entries;
+    index.ListDuplicates(classes, starts, entries);
+    for (size_t k = 0; k < classes.size(); k++) {
+        if (k > 0) {
+            printf("\n");
+        }
+        for (size_t j = starts[k]; j < starts[k + 1]; j++) {
+            printf("%0*llX %llu %s\n", ChecksumDigits(checksum), (unsigned long long)index.Checksum(classes[k]),
+                (unsigned long long)index.Size(classes[k]), results.names[entries[j]].c_str());
+        }
+    }
+    fprintf(stderr, "%zu groups of duplicates, %llu bytes wasted\n",
+        index.DuplicateClasses(), (unsigned long long)index.WastedBytes());
+}
+
+int Run(const std::vector<std::wstring>& args) {
+    Options options;
+    std::wstring error;
+    if (!ParseOptions(args, options, error) || (options.paths.empty() && options.verify.empty())) {
+        if (!error.empty()) {
+            fprintf(stderr, "%ls\n", error.c_str());
+        }
+        fprintf(stderr, "usage: equals-cli [options] PATH...\n%ls", OptionsHelp());
+        return 2;
+    }
+    ApplyOptions(options);
+
+    if (options.calibrate) {
+        for (int i = 0; i < Crc32SizeClassCount; i++) {
+            fprintf(stderr, "kernel %s: %s\n",
+                Crc32SizeClassName((Crc32SizeClass)i),
+                Crc32KernelName(SelectedCrc32Kernel((Crc32SizeClass)i)));
+        }
+    }
+
+    if (options.diff) {
+        return ReportDifferences(options.paths[0], options.paths[1], options.checksum);
+    }
+
+    if (!options.verify.empty()) {
+        return VerifyManifest(options.verify, options.checksum);
+    }
+
+    ChecksumType checksum = options.checksum.value_or(ChecksumType::Crc32);
+    ManifestWriter manifest;
+    if (!options.manifest.empty() && !manifest.Open(options.manifest, checksum, error)) {
+        fprintf(stderr, "%ls: %ls\n", options.manifest.c_str(), error.c_str());
+        return 2;
+    }
+    if (!options.copyTo.empty()) {
+        int result = CopyFiles(options.paths, options.copyTo, checksum, manifest);
+        return manifest.Close() ? result : 1;
+    }
+    fs::path blockMapDirectory = options.blockMaps;
+    if (!options.blockMaps.empty()) {
+        std::error_code ec{};
+        fs::create_directories(blockMapDirectory, ec);
+    }
+    // a manifest inside the tree would be hashed while it is still being written, and never verify
+    std::vector<fs::path> outputs;
+    if (manifest.IsOpen()) {
+        outputs.push_back(CanonicalPath(options.manifest));
+    }
+    if (!options.blockMaps.empty()) {
+        outputs.push_back(CanonicalPath(blockMapDirectory));
+    }
+    std::vector<fs::path> files = CollectFiles(options.paths, outputs);
+    if (options.overlap) {
+        return ReportOverlaps(files, checksum);
+    }
+    // devices read in one sweep are left out of the queues below, each goes to a single worker
+    std::vector<std::vector<size_t>> sweeps;
+    if (options.order != ReadOrder::Listed) {
+        SortByDiskOffset(files, options.order == ReadOrder::Auto, &sweeps);
+    }
+    std::vector<bool> swept(files.size(), false);
+    for (const std::vector<size_t>& sweep : sweeps) {
+        for (size_t i : sweep) {
+            swept[i] = true;
+        }
+    }
+    std::atomic<bool> failed{ false };
+    std::mutex mtx;
+    Results results;
+
+    // workers take several files at a time, so small ones can be hashed side by side
+    const size_t Batch = 64;
+
+    // one queue and one group of workers per NUMA node, files go to the node of their storage
+    // controller if it is known and are spread over all nodes otherwise; a group that runs out
+    // of work helps the others
+    struct Queue {
+        std::vector<size_t> files;
+        std::atomic<size_t> next{ 0 };
+    };
+    int nodes = NumaNodeCount();
+    std::vector<Queue> queues(nodes);
+    for (size_t i = 0; i < files.size(); i++) {
+        if (swept[i]) {
+            continue;
+        }
+        int node = NumaNodeOfFile(files[i]);
+        queues[node >= 0 ? node : (int)(i / Batch % nodes)].files.push_back(i);
+    }
+
+    // hash list[begin, begin + Batch) and print the results
+    auto hashBatch = [&](const std::vector<size_t>& list, size_t begin) {
+        std::vector<fs::path> paths;
+        std::vector<std::string> names;
+        std::vector<FileHash> hashes;
+        for (size_t j = begin; j < std::min(begin + Batch, list.size()); j++) {
+            // archive members take the place of the archive itself
+            const fs::path& file = files[list[j]];
+            if (!options.archives || !HashArchive(file, checksum, options.verifyArchives, names, hashes)) {
+                paths.push_back(file);
+            }
+        }
+        // names before this one are archive members, which aren't files --verify could open
+        size_t members = names.size();
+        std::vector<BlockMap> blocks;
+        std::vector<FileHash> fileHashes = HashFiles(paths, checksum, nullptr, options.blockMaps.empty() ? nullptr : &blocks);
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (!options.blockMaps.empty() && fileHashes[i].error.empty() && !blocks[i].Save(BlockMapPath(blockMapDirectory, paths[i]))) {
+                fileHashes[i].error = L"Failed to save block map";
+            }
+            names.push_back(paths[i].u8string());
+            hashes.push_back(std::move(fileHashes[i]));
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        for (size_t i = 0; i < names.size(); i++) {
+            const FileHash& hash = hashes[i];
+            if (!hash.error.empty()) {
+                fprintf(stderr, "%s: %ls\n", names[i].c_str(), hash.error.c_str());
+                failed = true;
+                continue;
+            }
+            if (manifest.IsOpen() && i >= members) {
+                manifest.Add(fs::u8path(names[i]), hash.crc);
+            }
+            if (options.duplicates) {
+                results.names.push_back(std::move(names[i]));
+                results.sizes.push_back(hash.size);
+                results.checksums.push_back(hash.crc);
+            } else {
+                printf("%0*llX %llu %s\n", ChecksumDigits(checksum), (unsigned long long)hash.crc,
+                    (unsigned long long)hash.size, names[i].c_str());
+            }
+        }
+    };
+
+    std::atomic<size_t> nextSweep{ 0 };
+    std::vector<std::thread> threads(std::max(1u, std::thread::hardware_concurrency()));
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t] = std::thread([&, home = (int)(t % nodes)]() {
+            if (nodes > 1) {
+                // before the thread's buffers are first touched, so they are allocated on its node
+                BindThreadToNumaNode(home);
+            }
+            // a second reader would send the head back and forth between two places of the sweep
+            for (size_t s; (s = nextSweep++) < sweeps.size(); ) {
+                for (size_t begin = 0; begin < sweeps[s].size(); begin += Batch) {
+                    hashBatch(sweeps[s], begin);
+                }
+            }
+            for (int k = 0; k < nodes; k++) {
+                Queue& queue = queues[(home + k) % nodes];
+                for (size_t begin; (begin = queue.next.fetch_add(Batch)) < queue.files.size(); ) {
+                    hashBatch(queue.files, begin);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (options.duplicates) {
+        ReportDuplicates(results, checksum);
+    }
+    if (!manifest.Close()) {
+        fprintf(stderr, "%ls: Failed to write manifest\n", options.manifest.c_str());
+        failed = true;
+    }
+
+    // a failure here only costs the next run its head start
+    SaveDeviceTuning();
+    if (options.verboseTuning) {
+        for (const std::string& line : DescribeDeviceTuning()) {
+            fprintf(stderr, "%s\n", line.c_str());
+        }
+    }
+    return failed ? 1 : 0;
+}
+
+} // anonymous namespace
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t** argv) {
+    return Run(std::vector<std::wstring>(argv + 1, argv + argc));
+}
+#else
+int main(int argc, char** argv) {
+    std::vector<std::wstring> args;
+    for (int i = 1; i < argc; i++) {
+        args.push_back(fs::path(argv[i]).wstring());
+    }
+    return Run(args);
+}
+#endif
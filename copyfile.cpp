@@ -0,0 +1,308 @@
+#include "copyfile.h"
+#include "bufferpool.h"
+#include "qos.h"
+
+#include <stdint.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const wchar_t* const CopyMismatchError = L"The copy differs from the source";
+
+namespace {
+
+/// a file opened for plain reads and writes, closed when it goes out of scope
+struct RawFile {
+    RawFile() = default;
+    RawFile(const RawFile&) = delete;
+    RawFile& operator=(const RawFile&) = delete;
+    ~RawFile() {
+        Close();
+    }
+
+#ifdef _WIN32
+    /// uncached reads need the whole buffer aligned to the sector size, pooled buffers are page-aligned
+    bool OpenForReading(const std::filesystem::path& path, bool uncached) {
+        handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN | (uncached ? FILE_FLAG_NO_BUFFERING : 0), NULL);
+        return handle != INVALID_HANDLE_VALUE;
+    }
+
+    bool Create(const std::filesystem::path& path) {
+        handle = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        return handle != INVALID_HANDLE_VALUE;
+    }
+
+    /// bytes read, 0 at the end of the file, -1 on failure
+    int64_t Read(uint8_t* data, size_t length) {
+        DWORD read;
+        if (!ReadFile(handle, data, (DWORD)length, &read, NULL)) {
+            return -1;
+        }
+        return read;
+    }
+
+    bool Write(const uint8_t* data, size_t length) {
+        while (length) {
+            DWORD written;
+            if (!WriteFile(handle, data, (DWORD)length, &written, NULL)) {
+                return false;
+            }
+            data += written;
+            length -= written;
+        }
+        return true;
+    }
+
+    /// move on without writing, the bytes in between read as zeros
+    bool Skip(uint64_t length) {
+        LARGE_INTEGER distance;
+        distance.QuadPart = (LONGLONG)length;
+        return SetFilePointerEx(handle, distance, NULL, FILE_CURRENT);
+    }
+
+    /// cut or extend the file to size, at the current position after Skip
+    bool Resize(uint64_t size) {
+        LARGE_INTEGER position;
+        position.QuadPart = (LONGLONG)size;
+        return SetFilePointerEx(handle, position, NULL, FILE_BEGIN) && SetEndOfFile(handle);
+    }
+
+    bool Sync() {
+        return FlushFileBuffers(handle);
+    }
+
+    void Close() {
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+            handle = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+    /// uncached reads go around the page cache, or drop it where O_DIRECT isn't supported (tmpfs)
+    bool OpenForReading(const std::filesystem::path& path, bool uncached) {
+#ifdef O_DIRECT
+        if (uncached) {
+            fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+            if (fd >= 0) {
+                return true;
+            }
+        }
+#endif
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0 && uncached) {
+#ifdef F_NOCACHE
+            fcntl(fd, F_NOCACHE, 1);
+#elif defined(POSIX_FADV_DONTNEED)
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+        }
+        return fd >= 0;
+    }
+
+    /// with the permissions of source
+    bool Create(const std::filesystem::path& path, const RawFile& source) {
+        struct stat info;
+        mode_t mode = fstat(source.fd, &info) == 0 ? info.st_mode & 0777 : 0644;
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+        return fd >= 0;
+    }
+
+    int64_t Read(uint8_t* data, size_t length) {
+        ssize_t read;
+        do {
+            read = ::read(fd, data, length);
+        } while (read < 0 && errno == EINTR);
+        return read;
+    }
+
+    bool Write(const uint8_t* data, size_t length) {
+        while (length) {
+            ssize_t written = ::write(fd, data, length);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            data += written;
+            length -= (size_t)written;
+        }
+        return true;
+    }
+
+    bool Skip(uint64_t length) {
+        return lseek(fd, (off_t)length, SEEK_CUR) >= 0;
+    }
+
+    bool Resize(uint64_t size) {
+        return ftruncate(fd, (off_t)size) == 0;
+    }
+
+    bool Sync() {
+        return fsync(fd) == 0;
+    }
+
+    void Close() {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    int fd = -1;
+#endif
+};
+
+/// a block handed from the reading to the writing thread
+struct Slot {
+    uint8_t* data = nullptr;
+    size_t length = 0;
+    bool zeros = false;
+    bool full = false;
+};
+
+} // anonymous namespace
+
+FileHash CopyAndVerify(const std::filesystem::path& source, const std::filesystem::path& destination, ChecksumType type,
+    const HashProgressCallback& progress) {
+    FileHash result{};
+    std::error_code ec{};
+    if (std::filesystem::equivalent(source, destination, ec)) {
+        result.error = L"The copy would replace the source";
+        return result;
+    }
+
+    RawFile input, output;
+    if (!input.OpenForReading(source, false)) {
+        result.error = L"Failed to open file";
+        return result;
+    }
+#ifdef _WIN32
+    bool created = output.Create(destination);
+#else
+    bool created = output.Create(destination, input);
+#endif
+    if (!created) {
+        result.error = L"Failed to create the copy";
+        return result;
+    }
+    uint64_t total = std::filesystem::file_size(source, ec);
+
+    // double buffering: the writer writes one slot while this thread reads and hashes the other.
+    // Only the first buffer comes from the pool: waiting at the pool's cap for a second one while
+    // holding the first would deadlock copies against each other once the cap is below two per thread.
+    // The pooled one is page-aligned, as the uncached reads of the check need.
+    PooledBuffer buffer;
+    std::unique_ptr<uint8_t[]> second(new uint8_t[PooledBuffer::size]);
+    Slot slots[2];
+    slots[0].data = buffer.data;
+    slots[1].data = second.get();
+    std::mutex mtx;
+    std::condition_variable changed;
+    bool reading = true;
+    bool writeFailed = false;
+    std::thread writer([&]() {
+        for (int i = 0; ; i ^= 1) {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                changed.wait(lock, [&]() { return slots[i].full || !reading; });
+                if (!slots[i].full) {
+                    return;
+                }
+            }
+            // blocks of zeros become holes, a sparse disk image stays sparse
+            bool written = slots[i].zeros ? output.Skip(slots[i].length) : output.Write(slots[i].data, slots[i].length);
+            std::lock_guard<std::mutex> lock(mtx);
+            slots[i].full = false;
+            writeFailed = !written;
+            changed.notify_all();
+            if (!written) {
+                return;
+            }
+        }
+    });
+
+    for (int i = 0; ; i ^= 1) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            changed.wait(lock, [&]() { return !slots[i].full || writeFailed; });
+            if (writeFailed) {
+                break;
+            }
+        }
+        AwaitReadBudget(PooledBuffer::size);
+        int64_t read = input.Read(slots[i].data, PooledBuffer::size);
+        if (read < 0) {
+            result.error = L"Failed to read file";
+        }
+        if (read <= 0) {
+            break;
+        }
+        result.crc = UpdateChecksumSkipZeros(type, slots[i].data, (size_t)read, result.crc);
+        result.size += (uint64_t)read;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            slots[i].length = (size_t)read;
+            slots[i].zeros = IsAllZeros(slots[i].data, (size_t)read);
+            slots[i].full = true;
+            changed.notify_all();
+        }
+        if (progress) {
+            progress(result.size, total);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        reading = false;
+        changed.notify_all();
+    }
+    writer.join();
+    input.Close();
+    // a hole at the end is only there once the size is set
+    if (writeFailed || (result.error.empty() && !(output.Resize(result.size) && output.Sync()))) {
+        result.error = L"Failed to write the copy";
+    }
+    output.Close();
+    if (!result.error.empty()) {
+        return result;
+    }
+
+    // the copy is on the disk now, read it back from there
+    RawFile check;
+    if (!check.OpenForReading(destination, true)) {
+        result.error = L"Failed to open the copy";
+        return result;
+    }
+    uint64_t checkSize = 0, checkCrc = 0;
+    for (;;) {
+        AwaitReadBudget(PooledBuffer::size);
+        int64_t read = check.Read(buffer.data, buffer.size);
+        if (read < 0) {
+            result.error = L"Failed to read the copy";
+            return result;
+        }
+        if (read == 0) {
+            break;
+        }
+        checkCrc = UpdateChecksumSkipZeros(type, buffer.data, (size_t)read, checkCrc);
+        checkSize += (uint64_t)read;
+    }
+    if (checkSize != result.size || checkCrc != result.crc) {
+        result.error = CopyMismatchError;
+    }
+    return result;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// Copying a file and checking the copy in one go. Hashing source and destination after a copy
+// reads every byte three times; here the source is read once, hashed while its blocks are
+// written to the destination by a second thread, and the destination is read back once with
+// the page cache bypassed (O_DIRECT, F_NOCACHE or FILE_FLAG_NO_BUFFERING), so the check sees
+// what reached the disk rather than what is still in memory.
+
+#include "checksum.h"
+#include "filehash.h"
+
+#include <filesystem>
+
+/// error of a copy whose destination read back with another checksum than the source
+extern const wchar_t* const CopyMismatchError;
+
+/// copy source to destination, replacing it, and verify the destination;
+/// the result is the size and checksum of the source, progress counts the bytes copied
+FileHash CopyAndVerify(
+    const std::filesystem::path& source,
+    const std::filesystem::path& destination,
+    ChecksumType type = ChecksumType::Crc32,
+    const HashProgressCallback& progress = nullptr);
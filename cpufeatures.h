@@ -0,0 +1,78 @@
+#pragma once
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CPUFEATURES_X86 1
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define CPUFEATURES_X86 1
+#endif
+
+/// instruction set extensions the CRC kernels can make use of
+struct CpuFeatures {
+    bool sse42 = false;
+    bool pclmul = false;
+    bool avx2 = false;
+    bool avx512f = false;
+    bool avx512bw = false;
+    /// carry-less multiply on 256 and 512 bit registers
+    bool vpclmulqdq = false;
+    /// simultaneous multithreading, sibling threads share the L1 cache with us
+    bool smt = false;
+
+    static const CpuFeatures& Get() {
+        static const CpuFeatures features = Detect();
+        return features;
+    }
+
+private:
+    static CpuFeatures Detect() {
+        CpuFeatures f;
+#ifdef CPUFEATURES_X86
+        unsigned int regs[4] = {};
+        Cpuid(0, 0, regs);
+        unsigned int maxLeaf = regs[0];
+
+        Cpuid(1, 0, regs);
+        f.sse42 = (regs[2] >> 20) & 1;
+        f.pclmul = (regs[2] >> 1) & 1;
+        f.smt = (regs[3] >> 28) & 1;
+        bool osxsave = (regs[2] >> 27) & 1;
+        bool avx = (regs[2] >> 28) & 1;
+
+        // the OS must save the wide registers on context switches
+        unsigned long long xcr0 = osxsave ? Xgetbv() : 0;
+        bool ymmEnabled = (xcr0 & 0x06) == 0x06;
+        bool zmmEnabled = (xcr0 & 0xE6) == 0xE6;
+
+        if (maxLeaf >= 7) {
+            Cpuid(7, 0, regs);
+            f.avx2 = avx && ymmEnabled && ((regs[1] >> 5) & 1);
+            f.avx512f = zmmEnabled && ((regs[1] >> 16) & 1);
+            f.avx512bw = f.avx512f && ((regs[1] >> 30) & 1);
+            f.vpclmulqdq = avx && ymmEnabled && f.pclmul && ((regs[2] >> 10) & 1);
+        }
+#endif
+        return f;
+    }
+
+#ifdef CPUFEATURES_X86
+    static void Cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+        __cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    static unsigned long long Xgetbv() {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return ((unsigned long long)edx << 32) | eax;
+#endif
+    }
+#endif
+};
@@ -18,6 +18,7 @@
 
 
 #include "crc32.h"
+#include "crcengine.h"
 
 #ifndef __LITTLE_ENDIAN
 #define __LITTLE_ENDIAN 1234
@@ -367,9 +368,9 @@ uint32_t crc32_4x8bytes(const void* data, size_t length, uint32_t previousCrc32)
 #endif // CRC32_USE_LOOKUP_TABLE_SLICING_BY_8
 
 
-#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
-/// compute CRC32 (Slicing-by-16 algorithm)
-uint32_t crc32_16bytes(const void* data, size_t length, uint32_t previousCrc32) {
+/// Slicing-by-16 for any reflected 32 bit polynomial, lookup holds its 16 tables
+/// (shared by crc32_16bytes and crc32c_16bytes)
+static inline uint32_t slicing16(const uint32_t lookup[][256], const void* data, size_t length, uint32_t previousCrc32) {
     uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
     const uint32_t* current = (const uint32_t*)data;
 
@@ -384,43 +385,43 @@ uint32_t crc32_16bytes(const void* data, size_t length, uint32_t previousCrc32)
             uint32_t two = *current++;
             uint32_t three = *current++;
             uint32_t four = *current++;
-            crc = Crc32Lookup[0][four & 0xFF] ^
-                Crc32Lookup[1][(four >> 8) & 0xFF] ^
-                Crc32Lookup[2][(four >> 16) & 0xFF] ^
-                Crc32Lookup[3][(four >> 24) & 0xFF] ^
-                Crc32Lookup[4][three & 0xFF] ^
-                Crc32Lookup[5][(three >> 8) & 0xFF] ^
-                Crc32Lookup[6][(three >> 16) & 0xFF] ^
-                Crc32Lookup[7][(three >> 24) & 0xFF] ^
-                Crc32Lookup[8][two & 0xFF] ^
-                Crc32Lookup[9][(two >> 8) & 0xFF] ^
-                Crc32Lookup[10][(two >> 16) & 0xFF] ^
-                Crc32Lookup[11][(two >> 24) & 0xFF] ^
-                Crc32Lookup[12][one & 0xFF] ^
-                Crc32Lookup[13][(one >> 8) & 0xFF] ^
-                Crc32Lookup[14][(one >> 16) & 0xFF] ^
-                Crc32Lookup[15][(one >> 24) & 0xFF];
+            crc = lookup[0][four & 0xFF] ^
+                lookup[1][(four >> 8) & 0xFF] ^
+                lookup[2][(four >> 16) & 0xFF] ^
+                lookup[3][(four >> 24) & 0xFF] ^
+                lookup[4][three & 0xFF] ^
+                lookup[5][(three >> 8) & 0xFF] ^
+                lookup[6][(three >> 16) & 0xFF] ^
+                lookup[7][(three >> 24) & 0xFF] ^
+                lookup[8][two & 0xFF] ^
+                lookup[9][(two >> 8) & 0xFF] ^
+                lookup[10][(two >> 16) & 0xFF] ^
+                lookup[11][(two >> 24) & 0xFF] ^
+                lookup[12][one & 0xFF] ^
+                lookup[13][(one >> 8) & 0xFF] ^
+                lookup[14][(one >> 16) & 0xFF] ^
+                lookup[15][(one >> 24) & 0xFF];
 #else
             uint32_t one = *current++ ^ crc;
             uint32_t two = *current++;
             uint32_t three = *current++;
             uint32_t four = *current++;
-            crc = Crc32Lookup[0][(four >> 24) & 0xFF] ^
-                Crc32Lookup[1][(four >> 16) & 0xFF] ^
-                Crc32Lookup[2][(four >> 8) & 0xFF] ^
-                Crc32Lookup[3][four & 0xFF] ^
-                Crc32Lookup[4][(three >> 24) & 0xFF] ^
-                Crc32Lookup[5][(three >> 16) & 0xFF] ^
-                Crc32Lookup[6][(three >> 8) & 0xFF] ^
-                Crc32Lookup[7][three & 0xFF] ^
-                Crc32Lookup[8][(two >> 24) & 0xFF] ^
-                Crc32Lookup[9][(two >> 16) & 0xFF] ^
-                Crc32Lookup[10][(two >> 8) & 0xFF] ^
-                Crc32Lookup[11][two & 0xFF] ^
-                Crc32Lookup[12][(one >> 24) & 0xFF] ^
-                Crc32Lookup[13][(one >> 16) & 0xFF] ^
-                Crc32Lookup[14][(one >> 8) & 0xFF] ^
-                Crc32Lookup[15][one & 0xFF];
+            crc = lookup[0][(four >> 24) & 0xFF] ^
+                lookup[1][(four >> 16) & 0xFF] ^
+                lookup[2][(four >> 8) & 0xFF] ^
+                lookup[3][four & 0xFF] ^
+                lookup[4][(three >> 24) & 0xFF] ^
+                lookup[5][(three >> 16) & 0xFF] ^
+                lookup[6][(three >> 8) & 0xFF] ^
+                lookup[7][three & 0xFF] ^
+                lookup[8][(two >> 24) & 0xFF] ^
+                lookup[9][(two >> 16) & 0xFF] ^
+                lookup[10][(two >> 8) & 0xFF] ^
+                lookup[11][two & 0xFF] ^
+                lookup[12][(one >> 24) & 0xFF] ^
+                lookup[13][(one >> 16) & 0xFF] ^
+                lookup[14][(one >> 8) & 0xFF] ^
+                lookup[15][one & 0xFF];
 #endif
         }
 
@@ -430,12 +431,19 @@ uint32_t crc32_16bytes(const void* data, size_t length, uint32_t previousCrc32)
     const uint8_t* currentChar = (const uint8_t*)current;
     // remaining 1 to 63 bytes (standard algorithm)
     while (length-- != 0)
-        crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ *currentChar++];
+        crc = (crc >> 8) ^ lookup[0][(crc & 0xFF) ^ *currentChar++];
 
     return ~crc; // same as crc ^ 0xFFFFFFFF
 }
 
 
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+/// compute CRC32 (Slicing-by-16 algorithm)
+uint32_t crc32_16bytes(const void* data, size_t length, uint32_t previousCrc32) {
+    return slicing16(Crc32Lookup, data, length, previousCrc32);
+}
+
+
 /// compute CRC32 (Slicing-by-16 algorithm, prefetch upcoming data blocks)
 uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previousCrc32, size_t prefetchAhead) {
     // CRC code is identical to crc32_16bytes (including unrolling), only added prefetching
@@ -510,24 +518,11 @@ uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previo
 #endif
 
 
-/// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
-uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32) {
-#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
-    return crc32_16bytes(data, length, previousCrc32);
-#elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_8)
-    return crc32_8bytes(data, length, previousCrc32);
-#elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_4)
-    return crc32_4bytes(data, length, previousCrc32);
-#elif defined(CRC32_USE_LOOKUP_TABLE_BYTE)
-    return crc32_1byte(data, length, previousCrc32);
-#else
-    return crc32_halfbyte(data, length, previousCrc32);
-#endif
-}
+// crc32_fast is defined in crc32dispatch.cpp, it picks one of the kernels above at runtime
 
 
-/// merge two CRC32 such that result = crc32(dataB, lengthB, crc32(dataA, lengthA))
-uint32_t crc32_combine(uint32_t crcA, uint32_t crcB, size_t lengthB) {
+/// merge two CRCs of any reflected 32 bit polynomial (shared by crc32_combine and crc32c_combine)
+static uint32_t combine(uint32_t polynomial, uint32_t crcA, uint32_t crcB, size_t lengthB) {
     // based on Mark Adler's crc_combine from
     // https://github.com/madler/pigz/blob/master/pigz.c
 
@@ -566,7 +561,7 @@ uint32_t crc32_combine(uint32_t crcA, uint32_t crcB, size_t lengthB) {
     uint32_t even[CrcBits]; // even-power-of-two zeros operator
 
     // put operator for one zero bit in odd
-    odd[0] = Polynomial;    // CRC-32 polynomial
+    odd[0] = polynomial;    // CRC-32 polynomial
     for (int i = 1; i < (int)CrcBits; i++)
         odd[i] = 1 << (i - 1);
 
@@ -622,6 +617,152 @@ uint32_t crc32_combine(uint32_t crcA, uint32_t crcB, size_t lengthB) {
 }
 
 
+/// merge two CRC32 such that result = crc32(dataB, lengthB, crc32(dataA, lengthA))
+uint32_t crc32_combine(uint32_t crcA, uint32_t crcB, size_t lengthB) {
+    return combine(Polynomial, crcA, crcB, lengthB);
+}
+
+
+// //////////////////////////////////////////////////////////
+// CRC32C (Castagnoli)
+
+
+namespace
+{
+    /// iSCSI's / ext4's CRC32C polynomial
+    const uint32_t PolynomialCastagnoli = Crc32cEngine::Polynomial;
+    static_assert(PolynomialCastagnoli == 0x82F63B78, "reflected Castagnoli polynomial");
+} // anonymous namespace
+
+
+/// compute CRC32C (bitwise algorithm)
+uint32_t crc32c_bitwise(const void* data, size_t length, uint32_t previousCrc32c) {
+    uint32_t crc = ~previousCrc32c;
+    const uint8_t* current = (const uint8_t*)data;
+
+    while (length-- != 0) {
+        crc ^= *current++;
+        for (int j = 0; j < 8; j++)
+            crc = (crc >> 1) ^ (-int32_t(crc & 1) & PolynomialCastagnoli);
+    }
+
+    return ~crc;
+}
+
+
+/// compute CRC32C (Slicing-by-16 algorithm)
+uint32_t crc32c_16bytes(const void* data, size_t length, uint32_t previousCrc32c) {
+    return slicing16(Crc32cEngine::Lookup.table, data, length, previousCrc32c);
+}
+
+
+/// merge two CRC32C such that result = crc32c(dataB, lengthB, crc32c(dataA, lengthA))
+uint32_t crc32c_combine(uint32_t crcA, uint32_t crcB, size_t lengthB) {
+    return combine(PolynomialCastagnoli, crcA, crcB, lengthB);
+}
+
+
+#ifdef CRC32C_USE_SSE42
+#include <nmmintrin.h>
+#include <string.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define TARGET_SSE42
+#endif
+
+namespace
+{
+    /// advances a raw CRC32C register over a fixed number of zero bytes,
+    /// the GF(2) matrix of crc32c_combine is tabulated per byte of the register
+    struct Crc32cShift {
+        uint32_t lookup[4][256];
+
+        explicit Crc32cShift(size_t length) {
+            uint32_t column[32];
+            for (int bit = 0; bit < 32; bit++)
+                column[bit] = combine(PolynomialCastagnoli, uint32_t(1) << bit, 0, length);
+
+            for (int k = 0; k < 4; k++)
+                for (int i = 0; i <= 0xFF; i++) {
+                    uint32_t sum = 0;
+                    for (int bit = 0; bit < 8; bit++)
+                        if (i & (1 << bit))
+                            sum ^= column[8 * k + bit];
+                    lookup[k][i] = sum;
+                }
+        }
+
+        uint32_t operator()(uint32_t crc) const {
+            return lookup[0][crc & 0xFF] ^
+                lookup[1][(crc >> 8) & 0xFF] ^
+                lookup[2][(crc >> 16) & 0xFF] ^
+                lookup[3][crc >> 24];
+        }
+    };
+
+    inline uint64_t load64(const uint8_t* data) {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    /// hash three adjacent blocks of blockSize bytes as independent streams, so three crc32
+    /// instructions are in flight at once, then merge them: crc = shift(shift(a) ^ b) ^ c
+    TARGET_SSE42 inline uint64_t crc32c_3way(uint64_t crc0, const uint8_t* current, size_t blockSize, const Crc32cShift& shift) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        for (const uint8_t* end = current + blockSize; current != end; current += 8) {
+            crc0 = _mm_crc32_u64(crc0, load64(current));
+            crc1 = _mm_crc32_u64(crc1, load64(current + blockSize));
+            crc2 = _mm_crc32_u64(crc2, load64(current + 2 * blockSize));
+        }
+        crc0 = shift((uint32_t)crc0) ^ crc1;
+        return shift((uint32_t)crc0) ^ crc2;
+    }
+} // anonymous namespace
+
+
+/// compute CRC32C (SSE4.2 crc32 instruction, three interleaved streams)
+TARGET_SSE42 uint32_t crc32c_sse42(const void* data, size_t length, uint32_t previousCrc32c) {
+    // the crc32 instruction has a latency of 3 cycles but a throughput of 1 per cycle
+    const size_t LongBlock = 8192;
+    const size_t ShortBlock = 256;
+    static const Crc32cShift shiftLong(LongBlock);
+    static const Crc32cShift shiftShort(ShortBlock);
+
+    uint64_t crc = ~previousCrc32c;
+    const uint8_t* current = (const uint8_t*)data;
+
+    // align to 8 bytes
+    while (length != 0 && ((uintptr_t)current & 7) != 0) {
+        crc = _mm_crc32_u8((uint32_t)crc, *current++);
+        length--;
+    }
+
+    while (length >= 3 * LongBlock) {
+        crc = crc32c_3way(crc, current, LongBlock, shiftLong);
+        current += 3 * LongBlock;
+        length -= 3 * LongBlock;
+    }
+    while (length >= 3 * ShortBlock) {
+        crc = crc32c_3way(crc, current, ShortBlock, shiftShort);
+        current += 3 * ShortBlock;
+        length -= 3 * ShortBlock;
+    }
+
+    // remaining 0 to 767 bytes
+    for (; length >= 8; length -= 8, current += 8)
+        crc = _mm_crc32_u64(crc, load64(current));
+    while (length-- != 0)
+        crc = _mm_crc32_u8((uint32_t)crc, *current++);
+
+    return ~(uint32_t)crc;
+}
+#endif // CRC32C_USE_SSE42
+
+
 // //////////////////////////////////////////////////////////
 // constants
 
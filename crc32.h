@@ -28,7 +28,8 @@
 // size_t
 #include <cstddef>
 
-// crc32_fast selects the fastest algorithm depending on flags (CRC32_USE_LOOKUP_...)
+// crc32_fast selects the fastest algorithm depending on flags (CRC32_USE_LOOKUP_...),
+// a different one can be chosen or calibrated at runtime, see crc32dispatch.h
 /// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
 uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32 = 0);
 
@@ -68,3 +69,24 @@ uint32_t crc32_16bytes(const void* data, size_t length, uint32_t previousCrc32 =
 /// compute CRC32 (Slicing-by-16 algorithm, prefetch upcoming data blocks)
 uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previousCrc32 = 0, size_t prefetchAhead = 256);
 #endif
+
+
+// CRC32C (Castagnoli polynomial, used by iSCSI, ext4 and RocksDB)
+// its slicing tables come from Crc32cEngine (crcengine.h), not from Crc32Lookup
+
+/// compute CRC32C using the SSE4.2 crc32 instruction if available, otherwise Slicing-by-16
+uint32_t crc32c_fast(const void* data, size_t length, uint32_t previousCrc32c = 0);
+
+/// merge two CRC32C such that result = crc32c(dataB, lengthB, crc32c(dataA, lengthA))
+uint32_t crc32c_combine(uint32_t crcA, uint32_t crcB, size_t lengthB);
+
+/// compute CRC32C (bitwise algorithm)
+uint32_t crc32c_bitwise(const void* data, size_t length, uint32_t previousCrc32c = 0);
+/// compute CRC32C (Slicing-by-16 algorithm)
+uint32_t crc32c_16bytes(const void* data, size_t length, uint32_t previousCrc32c = 0);
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32C_USE_SSE42
+/// compute CRC32C (SSE4.2 crc32 instruction, three interleaved streams), the CPU must support SSE4.2
+uint32_t crc32c_sse42(const void* data, size_t length, uint32_t previousCrc32c = 0);
+#endif
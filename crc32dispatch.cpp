@@ -0,0 +1,206 @@
+#include "crc32dispatch.h"
+#include "crc32.h"
+#include "cpufeatures.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+using Crc32Function = uint32_t(*)(const void* data, size_t length, uint32_t previousCrc32);
+
+struct KernelInfo {
+    Crc32Kernel kernel;
+    Crc32Function function;
+};
+
+constexpr KernelInfo Kernels[] = {
+    { Crc32Kernel::Bitwise, [](const void* d, size_t n, uint32_t c) { return crc32_bitwise(d, n, c); } },
+    { Crc32Kernel::Halfbyte, [](const void* d, size_t n, uint32_t c) { return crc32_halfbyte(d, n, c); } },
+#ifdef CRC32_USE_LOOKUP_TABLE_BYTE
+    { Crc32Kernel::Byte, [](const void* d, size_t n, uint32_t c) { return crc32_1byte(d, n, c); } },
+#endif
+    { Crc32Kernel::Tableless, [](const void* d, size_t n, uint32_t c) { return crc32_1byte_tableless(d, n, c); } },
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_4
+    { Crc32Kernel::Slicing4, [](const void* d, size_t n, uint32_t c) { return crc32_4bytes(d, n, c); } },
+#endif
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_8
+    { Crc32Kernel::Slicing8, [](const void* d, size_t n, uint32_t c) { return crc32_8bytes(d, n, c); } },
+    { Crc32Kernel::Slicing4x8, [](const void* d, size_t n, uint32_t c) { return crc32_4x8bytes(d, n, c); } },
+#endif
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+    { Crc32Kernel::Slicing16, [](const void* d, size_t n, uint32_t c) { return crc32_16bytes(d, n, c); } },
+    { Crc32Kernel::Slicing16Prefetch, [](const void* d, size_t n, uint32_t c) { return crc32_16bytes_prefetch(d, n, c); } },
+#endif
+};
+
+constexpr const KernelInfo* FindKernel(Crc32Kernel kernel) {
+    for (const KernelInfo& info : Kernels) {
+        if (info.kernel == kernel) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+/// the fastest kernel the CRC32_USE_LOOKUP_TABLE_* flags allow, as crc32_fast always used to be
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+constexpr const KernelInfo* DefaultKernel = FindKernel(Crc32Kernel::Slicing16);
+#elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_8)
+constexpr const KernelInfo* DefaultKernel = FindKernel(Crc32Kernel::Slicing8);
+#elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_4)
+constexpr const KernelInfo* DefaultKernel = FindKernel(Crc32Kernel::Slicing4);
+#elif defined(CRC32_USE_LOOKUP_TABLE_BYTE)
+constexpr const KernelInfo* DefaultKernel = FindKernel(Crc32Kernel::Byte);
+#else
+constexpr const KernelInfo* DefaultKernel = FindKernel(Crc32Kernel::Halfbyte);
+#endif
+
+/// selected kernel per size class, read on every crc32_fast call
+/// (constant initialized, so crc32_fast works during static initialization too)
+std::atomic<const KernelInfo*> Selection[Crc32SizeClassCount] = { DefaultKernel, DefaultKernel, DefaultKernel };
+
+/// representative buffer sizes of each size class used for calibration
+const size_t CalibrationSizes[Crc32SizeClassCount][2] = {
+    { 64, 300 },
+    { 4 * 1024, 32 * 1024 },
+    { 256 * 1024, 1024 * 1024 },
+};
+
+} // anonymous namespace
+
+const char* Crc32KernelName(Crc32Kernel kernel) {
+    switch (kernel) {
+    case Crc32Kernel::Bitwise: return "bitwise";
+    case Crc32Kernel::Halfbyte: return "halfbyte";
+    case Crc32Kernel::Byte: return "1byte";
+    case Crc32Kernel::Tableless: return "1byte_tableless";
+    case Crc32Kernel::Slicing4: return "4bytes";
+    case Crc32Kernel::Slicing8: return "8bytes";
+    case Crc32Kernel::Slicing4x8: return "4x8bytes";
+    case Crc32Kernel::Slicing16: return "16bytes";
+    case Crc32Kernel::Slicing16Prefetch: return "16bytes_prefetch";
+    }
+    return "unknown";
+}
+
+const char* Crc32SizeClassName(Crc32SizeClass sizeClass) {
+    switch (sizeClass) {
+    case Crc32SizeClass::Small: return "small";
+    case Crc32SizeClass::Medium: return "medium";
+    case Crc32SizeClass::Large: return "large";
+    }
+    return "unknown";
+}
+
+bool ParseCrc32Kernel(const char* name, Crc32Kernel& kernel) {
+    for (const KernelInfo& info : Kernels) {
+        if (strcmp(Crc32KernelName(info.kernel), name) == 0) {
+            kernel = info.kernel;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsCrc32KernelAvailable(Crc32Kernel kernel) {
+    return FindKernel(kernel) != nullptr;
+}
+
+bool SelectCrc32Kernel(Crc32Kernel kernel) {
+    for (int i = 0; i < Crc32SizeClassCount; i++) {
+        if (!SelectCrc32Kernel((Crc32SizeClass)i, kernel)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SelectCrc32Kernel(Crc32SizeClass sizeClass, Crc32Kernel kernel) {
+    const KernelInfo* info = FindKernel(kernel);
+    if (!info) {
+        return false;
+    }
+    Selection[(int)sizeClass].store(info, std::memory_order_relaxed);
+    return true;
+}
+
+Crc32Kernel SelectedCrc32Kernel(Crc32SizeClass sizeClass) {
+    return Selection[(int)sizeClass].load(std::memory_order_relaxed)->kernel;
+}
+
+void CalibrateCrc32(double seconds) {
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<uint8_t> data(CalibrationSizes[Crc32SizeClassCount - 1][1]);
+    uint32_t state = 1;
+    for (auto& byte : data) {
+        state = state * 1664525 + 1013904223;
+        byte = (uint8_t)(state >> 24);
+    }
+
+    // the bitwise kernel is never competitive, don't spend time on it
+    size_t candidates = sizeof(Kernels) / sizeof(Kernels[0]) - 1;
+    double budget = seconds / (Crc32SizeClassCount * 2 * candidates);
+
+    for (int sizeClass = 0; sizeClass < Crc32SizeClassCount; sizeClass++) {
+        const KernelInfo* best = nullptr;
+        double bestTime = 0;
+
+        for (const KernelInfo& info : Kernels) {
+            if (info.kernel == Crc32Kernel::Bitwise) {
+                continue;
+            }
+
+            // odd offset and length so the tail loops are checked as well
+            if (info.function(data.data() + 1, 1001, 0) != crc32_bitwise(data.data() + 1, 1001, 0)) {
+                continue;
+            }
+
+            // time per byte, summed over both sizes of the class
+            double time = 0;
+            for (size_t size : CalibrationSizes[sizeClass]) {
+                volatile uint32_t sink = info.function(data.data(), size, 0);
+                uint64_t bytes = 0;
+                auto start = Clock::now();
+                double elapsed = 0;
+                do {
+                    for (int i = 0; i < 16; i++) {
+                        sink = info.function(data.data(), size, sink);
+                    }
+                    bytes += 16 * size;
+                    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+                } while (elapsed < budget);
+                time += elapsed / bytes;
+            }
+
+            if (!best || time < bestTime) {
+                best = &info;
+                bestTime = time;
+            }
+        }
+
+        if (best) {
+            Selection[sizeClass].store(best, std::memory_order_relaxed);
+        }
+    }
+}
+
+/// compute CRC32 using the kernel selected for this buffer size
+uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32) {
+    const KernelInfo* info = Selection[(int)Crc32SizeClassOf(length)].load(std::memory_order_relaxed);
+    return info->function(data, length, previousCrc32);
+}
+
+/// compute CRC32C with the crc32 instruction where the CPU has SSE4.2
+uint32_t crc32c_fast(const void* data, size_t length, uint32_t previousCrc32c) {
+#ifdef CRC32C_USE_SSE42
+    static const Crc32Function kernel = CpuFeatures::Get().sse42 ? crc32c_sse42 : crc32c_16bytes;
+    return kernel(data, length, previousCrc32c);
+#else
+    return crc32c_16bytes(data, length, previousCrc32c);
+#endif
+}
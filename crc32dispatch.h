@@ -0,0 +1,54 @@
+#pragma once
+
+// Runtime selection of the kernel behind crc32_fast.
+// Without calibration crc32_fast keeps using the fastest kernel enabled by the
+// CRC32_USE_LOOKUP_TABLE_* flags in crc32.h, for every buffer size.
+
+#include <stddef.h>
+
+enum class Crc32Kernel {
+    Bitwise,
+    Halfbyte,
+    Byte,
+    Tableless,
+    Slicing4,
+    Slicing8,
+    Slicing4x8,
+    Slicing16,
+    Slicing16Prefetch,
+};
+
+/// buffer sizes for which crc32_fast chooses its kernel separately
+enum class Crc32SizeClass {
+    Small,  // below 512 bytes
+    Medium, // below 64 KiB
+    Large,
+};
+
+constexpr int Crc32SizeClassCount = 3;
+
+constexpr Crc32SizeClass Crc32SizeClassOf(size_t length) {
+    return length < 512 ? Crc32SizeClass::Small
+        : length < 64 * 1024 ? Crc32SizeClass::Medium
+        : Crc32SizeClass::Large;
+}
+
+const char* Crc32KernelName(Crc32Kernel kernel);
+const char* Crc32SizeClassName(Crc32SizeClass sizeClass);
+
+/// look up a kernel by the name Crc32KernelName returns
+bool ParseCrc32Kernel(const char* name, Crc32Kernel& kernel);
+
+/// whether the kernel is compiled in and the CPU can run it
+bool IsCrc32KernelAvailable(Crc32Kernel kernel);
+
+/// use kernel for all buffer sizes, returns false if it isn't available
+bool SelectCrc32Kernel(Crc32Kernel kernel);
+bool SelectCrc32Kernel(Crc32SizeClass sizeClass, Crc32Kernel kernel);
+
+Crc32Kernel SelectedCrc32Kernel(Crc32SizeClass sizeClass);
+
+/// time all available kernels on this machine and select the fastest one per size class
+/// - kernels whose output differs from crc32_bitwise are never selected
+/// - takes roughly the given number of seconds
+void CalibrateCrc32(double seconds = 0.05);
@@ -0,0 +1,83 @@
+#include "crc32stream.h"
+#include "crc32.h"
+
+#include <string.h>
+#include <new>
+
+void Crc32Stream::Update(const void* data, size_t size) {
+    const uint8_t* current = (const uint8_t*)data;
+    length += size;
+
+    // top up a partially filled block first
+    if (buffered) {
+        size_t take = BlockSize - buffered < size ? BlockSize - buffered : size;
+        memcpy(buffer + buffered, current, take);
+        buffered += take;
+        current += take;
+        size -= take;
+        if (buffered < BlockSize) {
+            return;
+        }
+        crc = crc32_fast(buffer, BlockSize, crc);
+        buffered = 0;
+    }
+
+    // whole blocks go straight to the kernel, only the remainder is copied
+    size_t direct = size - size % BlockSize;
+    if (direct) {
+        crc = crc32_fast(current, direct, crc);
+        current += direct;
+        size -= direct;
+    }
+
+    memcpy(buffer, current, size);
+    buffered = size;
+}
+
+uint32_t Crc32Stream::Final() const {
+    return crc32_fast(buffer, buffered, crc);
+}
+
+void Crc32Stream::Merge(const Crc32Stream& other) {
+    // other never flushed a block, so its raw bytes are still available
+    if (other.length == other.buffered) {
+        Update(other.buffer, other.buffered);
+        return;
+    }
+
+    crc = crc32_combine(Final(), other.Final(), (size_t)other.length);
+    length += other.length;
+    buffered = 0;
+}
+
+crc32_stream* crc32_stream_create(uint32_t previousCrc32) {
+    return (crc32_stream*)new (std::nothrow) Crc32Stream(previousCrc32);
+}
+
+void crc32_stream_destroy(crc32_stream* stream) {
+    delete (Crc32Stream*)stream;
+}
+
+void crc32_stream_reset(crc32_stream* stream, uint32_t previousCrc32) {
+    ((Crc32Stream*)stream)->Reset(previousCrc32);
+}
+
+void crc32_stream_update(crc32_stream* stream, const void* data, size_t length) {
+    ((Crc32Stream*)stream)->Update(data, length);
+}
+
+uint32_t crc32_stream_final(const crc32_stream* stream) {
+    return ((const Crc32Stream*)stream)->Final();
+}
+
+uint64_t crc32_stream_length(const crc32_stream* stream) {
+    return ((const Crc32Stream*)stream)->Length();
+}
+
+crc32_stream* crc32_stream_fork(const crc32_stream* stream) {
+    return (crc32_stream*)new (std::nothrow) Crc32Stream(((const Crc32Stream*)stream)->Fork());
+}
+
+void crc32_stream_merge(crc32_stream* stream, const crc32_stream* other) {
+    ((Crc32Stream*)stream)->Merge(*(const Crc32Stream*)other);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// uint8_t, uint32_t, uint64_t
+#include <stdint.h>
+// size_t
+#include <stddef.h>
+
+#ifdef __cplusplus
+
+/// incremental CRC32 over a stream of arbitrarily small writes
+/// - writes are collected in an internal buffer and handed to crc32_fast in BlockSize chunks,
+///   so the slicing kernels never fall back to their bytewise tail loop for tiny updates
+/// - Fork() starts an independent stream for the data that follows, Merge() appends it again
+struct Crc32Stream {
+    /// multiple of the 64 bytes crc32_16bytes consumes per iteration
+    static constexpr size_t BlockSize = 4096;
+
+    explicit Crc32Stream(uint32_t previousCrc32 = 0) {
+        Reset(previousCrc32);
+    }
+
+    void Reset(uint32_t previousCrc32 = 0) {
+        crc = previousCrc32;
+        length = 0;
+        buffered = 0;
+    }
+
+    void Update(const void* data, size_t size);
+
+    /// CRC32 of everything written so far, the stream can still be updated afterwards
+    uint32_t Final() const;
+
+    /// number of bytes written so far
+    uint64_t Length() const {
+        return length;
+    }
+
+    /// empty stream for hashing the data that follows this one, e.g. on another thread
+    Crc32Stream Fork() const {
+        return Crc32Stream();
+    }
+
+    /// append a stream created by Fork() such that Final() = crc32(this data + other data)
+    void Merge(const Crc32Stream& other);
+
+private:
+    uint32_t crc;
+    uint64_t length;
+    size_t buffered;
+    alignas(64) uint8_t buffer[BlockSize];
+};
+
+extern "C" {
+#endif
+
+/// opaque handle of the C interface, wraps a Crc32Stream
+typedef struct crc32_stream crc32_stream;
+
+crc32_stream* crc32_stream_create(uint32_t previousCrc32);
+void crc32_stream_destroy(crc32_stream* stream);
+void crc32_stream_reset(crc32_stream* stream, uint32_t previousCrc32);
+void crc32_stream_update(crc32_stream* stream, const void* data, size_t length);
+uint32_t crc32_stream_final(const crc32_stream* stream);
+uint64_t crc32_stream_length(const crc32_stream* stream);
+crc32_stream* crc32_stream_fork(const crc32_stream* stream);
+void crc32_stream_merge(crc32_stream* stream, const crc32_stream* other);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,97 @@
+#include "crc64.h"
+#include "crcengine.h"
+#include "cpufeatures.h"
+
+namespace
+{
+    /// ECMA-182 polynomial, highest power first
+    const uint64_t PolynomialEcma = 0x42F0E1EBA9EA3693;
+    static_assert(Crc64Engine::Polynomial == CrcDetail::Reflect<uint64_t>(PolynomialEcma, 64), "engine uses the ECMA-182 polynomial");
+
+    typedef uint64_t (*Crc64Function)(const void* data, size_t length, uint64_t previousCrc64);
+} // anonymous namespace
+
+
+/// compute CRC-64 (bitwise algorithm)
+uint64_t crc64_bitwise(const void* data, size_t length, uint64_t previousCrc64) {
+    return Crc64Engine::Bitwise((const uint8_t*)data, length, previousCrc64);
+}
+
+
+/// compute CRC-64 (Slicing-by-16 algorithm)
+uint64_t crc64_16bytes(const void* data, size_t length, uint64_t previousCrc64) {
+    return Crc64Engine::Update(data, length, previousCrc64);
+}
+
+
+/// merge two CRC-64 such that result = crc64(dataB, lengthB, crc64(dataA, lengthA))
+uint64_t crc64_combine(uint64_t crcA, uint64_t crcB, uint64_t lengthB) {
+    return Crc64Engine::Combine(crcA, crcB, lengthB);
+}
+
+
+#ifdef CRC64_USE_PCLMUL
+#include "crcfold.h"
+
+namespace
+{
+    constexpr CrcFold::Constant Fold128 = CrcFold::By<Crc64Engine>(128);
+    constexpr CrcFold::Constant Fold256 = CrcFold::By<Crc64Engine>(256);
+    constexpr CrcFold::Constant Fold384 = CrcFold::By<Crc64Engine>(384);
+    constexpr CrcFold::Constant Fold512 = CrcFold::By<Crc64Engine>(512);
+
+    TARGET_PCLMUL inline __m128i fold(__m128i value, const CrcFold::Constant& constant) {
+        return CrcFold::Fold(value, CrcFold::Multiplier(constant));
+    }
+
+    TARGET_PCLMUL inline __m128i load128(const uint8_t* data) {
+        return CrcFold::Load(data);
+    }
+} // anonymous namespace
+
+
+/// compute CRC-64 (PCLMULQDQ folding of four 16 byte lanes)
+TARGET_PCLMUL uint64_t crc64_pclmul(const void* data, size_t length, uint64_t previousCrc64) {
+    // clmul has a latency of several cycles, four independent lanes keep it busy
+    if (length < 64)
+        return crc64_16bytes(data, length, previousCrc64);
+
+    const uint8_t* current = (const uint8_t*)data;
+    // the register is added to the first 8 bytes, from then on it is folded like data
+    __m128i lane0 = _mm_xor_si128(load128(current), CrcFold::Start<Crc64Engine>(previousCrc64));
+    __m128i lane1 = load128(current + 16);
+    __m128i lane2 = load128(current + 32);
+    __m128i lane3 = load128(current + 48);
+    current += 64;
+    length -= 64;
+
+    for (; length >= 64; length -= 64, current += 64) {
+        lane0 = _mm_xor_si128(fold(lane0, Fold512), load128(current));
+        lane1 = _mm_xor_si128(fold(lane1, Fold512), load128(current + 16));
+        lane2 = _mm_xor_si128(fold(lane2, Fold512), load128(current + 32));
+        lane3 = _mm_xor_si128(fold(lane3, Fold512), load128(current + 48));
+    }
+
+    // merge the lanes, then the remaining 16 byte blocks
+    __m128i folded = _mm_xor_si128(
+        _mm_xor_si128(fold(lane0, Fold384), fold(lane1, Fold256)),
+        _mm_xor_si128(fold(lane2, Fold128), lane3));
+    for (; length >= 16; length -= 16, current += 16)
+        folded = _mm_xor_si128(fold(folded, Fold128), load128(current));
+
+    uint8_t remainder[16];
+    _mm_storeu_si128((__m128i*)remainder, folded);
+    return Crc64Engine::Update(current, length, CrcFold::Finish<Crc64Engine>(remainder));
+}
+#endif
+
+
+/// compute CRC-64 with carry-less multiplication where the CPU has PCLMULQDQ
+uint64_t crc64_fast(const void* data, size_t length, uint64_t previousCrc64) {
+#ifdef CRC64_USE_PCLMUL
+    static const Crc64Function kernel = CpuFeatures::Get().pclmul ? crc64_pclmul : crc64_16bytes;
+    return kernel(data, length, previousCrc64);
+#else
+    return crc64_16bytes(data, length, previousCrc64);
+#endif
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// CRC-64/XZ (ECMA-182 polynomial, reflected, as used by xz and 7-Zip)
+// a 64 bit checksum keeps accidental collisions out of reach even for millions of files,
+// the slicing tables come from Crc64Engine (crcengine.h)
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// compute CRC-64 using carry-less multiplication if available, otherwise Slicing-by-16
+uint64_t crc64_fast(const void* data, size_t length, uint64_t previousCrc64 = 0);
+
+/// merge two CRC-64 such that result = crc64(dataB, lengthB, crc64(dataA, lengthA))
+uint64_t crc64_combine(uint64_t crcA, uint64_t crcB, uint64_t lengthB);
+
+/// compute CRC-64 (bitwise algorithm)
+uint64_t crc64_bitwise(const void* data, size_t length, uint64_t previousCrc64 = 0);
+/// compute CRC-64 (Slicing-by-16 algorithm)
+uint64_t crc64_16bytes(const void* data, size_t length, uint64_t previousCrc64 = 0);
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC64_USE_PCLMUL
+/// compute CRC-64 (PCLMULQDQ folding of four 16 byte lanes), the CPU must support PCLMULQDQ
+uint64_t crc64_pclmul(const void* data, size_t length, uint64_t previousCrc64 = 0);
+#endif
@@ -0,0 +1,267 @@
+#pragma once
+
+// Header-only CRC of any width from 8 to 64 bits, any polynomial, reflected or not.
+// The slicing tables are computed by the compiler, so a new CRC costs one type alias:
+//   using Crc32cEngine = CrcEngine<32, 0x1EDC6F41, true>;
+// Like crc32.h, every CRC starts from all ones and is inverted at the end, and the
+// previous value of a CRC is passed in to continue it over more data.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+
+namespace CrcDetail {
+
+    // shifting a 32 bit value by 32 is undefined, these return 0 instead
+    template <typename Value>
+    constexpr Value Shr(Value value, int bits) {
+        return bits >= (int)sizeof(Value) * 8 ? 0 : value >> bits;
+    }
+    template <typename Value>
+    constexpr Value Shl(Value value, int bits) {
+        return bits >= (int)sizeof(Value) * 8 ? 0 : value << bits;
+    }
+
+    template <typename Value>
+    constexpr Value Mask(int width) {
+        return (Value)(~(uint64_t)0 >> (64 - width));
+    }
+
+    template <typename Value>
+    constexpr Value Reflect(uint64_t poly, int width) {
+        Value result = 0;
+        for (int i = 0; i < width; i++)
+            if ((poly >> i) & 1)
+                result |= (Value)1 << (width - 1 - i);
+        return result;
+    }
+
+    /// advance the raw shift register by one zero byte
+    template <typename Value>
+    constexpr Value ByteStep(Value crc, Value polynomial, int width, bool reflected) {
+        for (int j = 0; j < 8; j++) {
+            if (reflected)
+                crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
+            else
+                crc = ((crc << 1) ^ ((crc >> (width - 1)) & 1 ? polynomial : 0)) & Mask<Value>(width);
+        }
+        return crc;
+    }
+
+    /// Slicing-by-16 tables, table[k][b] advances byte b over k further zero bytes
+    template <typename Value>
+    struct Tables {
+        Value table[16][256];
+    };
+
+    template <typename Value>
+    constexpr Tables<Value> MakeTables(Value polynomial, int width, bool reflected) {
+        Tables<Value> t{};
+        for (int i = 0; i <= 0xFF; i++)
+            t.table[0][i] = ByteStep<Value>(reflected ? (Value)i : (Value)i << (width - 8), polynomial, width, reflected);
+
+        // same recurrence as the slicing-by-8 tables in crc32.cpp
+        for (int slice = 1; slice < 16; slice++)
+            for (int i = 0; i <= 0xFF; i++) {
+                Value prev = t.table[slice - 1][i];
+                t.table[slice][i] = reflected
+                    ? Shr(prev, 8) ^ t.table[0][prev & 0xFF]
+                    : (Shl(prev, 8) & Mask<Value>(width)) ^ t.table[0][(prev >> (width - 8)) & 0xFF];
+            }
+        return t;
+    }
+
+} // namespace CrcDetail
+
+/// Poly is written the usual way (highest power first, x^Width omitted),
+/// Reflected processes the least significant bit of each byte first
+template <int Width, uint64_t Poly, bool Reflected>
+struct CrcEngine {
+    static_assert(Width >= 8 && Width <= 64 && Width % 8 == 0, "width must be a multiple of 8 between 8 and 64");
+
+    using Value = std::conditional_t<(Width <= 32), uint32_t, uint64_t>;
+
+    static constexpr int Bits = Width;
+    /// polynomial written the usual way, as given
+    static constexpr uint64_t Normal = Poly;
+
+    static constexpr Value Mask = CrcDetail::Mask<Value>(Width);
+
+    /// polynomial in the bit order the shift register uses
+    static constexpr Value Polynomial = Reflected ? CrcDetail::Reflect<Value>(Poly, Width) : (Value)Poly;
+
+    /// Slicing-by-16 tables, generated by the compiler
+    static constexpr CrcDetail::Tables<Value> Lookup = CrcDetail::MakeTables<Value>(Polynomial, Width, Reflected);
+
+    /// compute CRC (bitwise algorithm), the reference every other variant is checked against
+    static constexpr Value Bitwise(const uint8_t* data, size_t length, Value previous = 0) {
+        Value crc = ~previous & Mask;
+        while (length-- != 0) {
+            if (Reflected) {
+                crc ^= *data++;
+                for (int j = 0; j < 8; j++)
+                    crc = (crc >> 1) ^ ((crc & 1) ? Polynomial : 0);
+            } else {
+                crc ^= (Value)*data++ << (Width - 8);
+                for (int j = 0; j < 8; j++)
+                    crc = ((crc << 1) ^ ((crc >> (Width - 1)) & 1 ? Polynomial : 0)) & Mask;
+            }
+        }
+        return ~crc & Mask;
+    }
+
+    /// compute CRC (Slicing-by-N algorithm, N = 1, 4, 8 or 16)
+    template <int Slices>
+    static constexpr Value Slicing(const uint8_t* data, size_t length, Value previous = 0) {
+        static_assert(Slices == 1 || Slices == 4 || Slices == 8 || Slices == 16, "unsupported number of slices");
+        Value crc = ~previous & Mask;
+
+        // process Slices bytes at once, as 32 bit words like crc32_4bytes/8bytes/16bytes
+        if constexpr (Slices > 1) {
+            for (; length >= (size_t)Slices; length -= Slices, data += Slices) {
+                Value sum = SliceBlock<Slices>(data, crc, std::make_index_sequence<Slices / 4>());
+                // CRC bytes beyond the block haven't been consumed yet
+                if (Slices < Bytes)
+                    sum ^= Reflected ? CrcDetail::Shr(crc, 8 * Slices) : CrcDetail::Shl(crc, 8 * Slices) & Mask;
+                crc = sum;
+            }
+        }
+
+        // remaining bytes (standard algorithm)
+        for (; length != 0; length--, data++) {
+            if (Reflected)
+                crc = CrcDetail::Shr(crc, 8) ^ Lookup.table[0][(crc ^ *data) & 0xFF];
+            else
+                crc = (CrcDetail::Shl(crc, 8) & Mask) ^ Lookup.table[0][((crc >> (Width - 8)) ^ *data) & 0xFF];
+        }
+
+        return ~crc & Mask;
+    }
+
+    /// compute CRC using Slicing-by-16
+    static Value Update(const void* data, size_t length, Value previous = 0) {
+        return Slicing<16>((const uint8_t*)data, length, previous);
+    }
+
+    /// raw shift register after feeding it length zero bytes, O(log length) like crc32_combine
+    static constexpr Value ShiftZeros(Value crc, uint64_t length) {
+        // operator for one zero byte, column i is the image of bit i
+        Matrix op{};
+        for (int i = 0; i < Width; i++)
+            op.column[i] = CrcDetail::ByteStep<Value>((Value)1 << i, Polynomial, Width, Reflected);
+
+        for (; length != 0; length >>= 1) {
+            if (length & 1)
+                crc = op.Times(crc);
+            op = op.Times(op);
+        }
+        return crc;
+    }
+
+    /// merge two CRCs such that result = crc(dataB, lengthB, crc(dataA, lengthA))
+    static constexpr Value Combine(Value crcA, Value crcB, uint64_t lengthB) {
+        return ShiftZeros(crcA, lengthB) ^ crcB;
+    }
+
+    /// CRC of the nine ASCII digits "123456789", listed for every CRC in the catalogues
+    static constexpr Value Check() {
+        const uint8_t digits[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+        return Bitwise(digits, sizeof(digits));
+    }
+
+    /// compare all table driven variants with Bitwise at compile time
+    static constexpr bool SelfTest() {
+        uint8_t data[67] = {};
+        uint32_t state = 1;
+        for (auto& byte : data) {
+            state = state * 1664525 + 1013904223;
+            byte = (uint8_t)(state >> 24);
+        }
+        Value expected = Bitwise(data, sizeof(data), 0x1234);
+        return Slicing<1>(data, sizeof(data), 0x1234) == expected &&
+            Slicing<4>(data, sizeof(data), 0x1234) == expected &&
+            Slicing<8>(data, sizeof(data), 0x1234) == expected &&
+            Slicing<16>(data, sizeof(data), 0x1234) == expected &&
+            Combine(Bitwise(data, 20), Bitwise(data + 20, 47), 47) == Bitwise(data, 67);
+    }
+
+private:
+    static constexpr int Bytes = Width / 8;
+
+    /// look up one 32 bit word of a slicing block, the first Width/8 bytes are combined with the current CRC
+    template <int Slices, size_t Word>
+    static constexpr Value SliceWord(const uint8_t* data, Value crc) {
+        const uint8_t* bytes = data + 4 * Word;
+        // the byte-wise loads compile to single word loads (at least -O2)
+        uint32_t value = Reflected
+            ? (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24
+            : (uint32_t)bytes[3] | (uint32_t)bytes[2] << 8 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[0] << 24;
+        if (4 * (int)Word < Bytes) {
+            if (Reflected)
+                value ^= (uint32_t)CrcDetail::Shr(crc, 32 * Word);
+            else if (Width >= 32 * (int)Word + 32)
+                value ^= (uint32_t)(crc >> (Width - 32 - 32 * Word));
+            else
+                value ^= (uint32_t)crc << (32 - Width);
+        }
+
+        constexpr int Slice = Slices - 1 - 4 * (int)Word;
+        return Reflected
+            ? Lookup.table[Slice][value & 0xFF] ^ Lookup.table[Slice - 1][(value >> 8) & 0xFF] ^
+              Lookup.table[Slice - 2][(value >> 16) & 0xFF] ^ Lookup.table[Slice - 3][value >> 24]
+            : Lookup.table[Slice][value >> 24] ^ Lookup.table[Slice - 1][(value >> 16) & 0xFF] ^
+              Lookup.table[Slice - 2][(value >> 8) & 0xFF] ^ Lookup.table[Slice - 3][value & 0xFF];
+    }
+
+    /// all words of a slicing block, unrolled at compile time
+    template <int Slices, size_t... Words>
+    static constexpr Value SliceBlock(const uint8_t* data, Value crc, std::index_sequence<Words...>) {
+        return (SliceWord<Slices, Words>(data, crc) ^ ...);
+    }
+
+    /// linear map over GF(2), stored by columns
+    struct Matrix {
+        Value column[Width];
+
+        constexpr Value Times(Value vec) const {
+            Value sum = 0;
+            for (int i = 0; vec != 0; i++, vec >>= 1)
+                if (vec & 1)
+                    sum ^= column[i];
+            return sum;
+        }
+
+        constexpr Matrix Times(const Matrix& other) const {
+            Matrix result{};
+            for (int i = 0; i < Width; i++)
+                result.column[i] = Times(other.column[i]);
+            return result;
+        }
+    };
+};
+
+/// zlib / PNG / Ethernet, same as crc32_fast
+using Crc32Engine = CrcEngine<32, 0x04C11DB7, true>;
+/// Castagnoli, same as crc32c_fast
+using Crc32cEngine = CrcEngine<32, 0x1EDC6F41, true>;
+/// CRC-64/XZ with the ECMA-182 polynomial, as used by xz and 7-Zip
+using Crc64Engine = CrcEngine<64, 0x42F0E1EBA9EA3693, true>;
+/// CRC-32/BZIP2, the unreflected zlib polynomial
+using Crc32Bzip2Engine = CrcEngine<32, 0x04C11DB7, false>;
+/// CRC-16/X-25 and CRC-16/GENIBUS, mostly to keep narrow widths honest
+using Crc16X25Engine = CrcEngine<16, 0x1021, true>;
+using Crc16GenibusEngine = CrcEngine<16, 0x1021, false>;
+
+static_assert(Crc32Engine::Check() == 0xCBF43926, "CRC-32 check value");
+static_assert(Crc32cEngine::Check() == 0xE3069283, "CRC-32C check value");
+static_assert(Crc64Engine::Check() == 0x995DC9BBDF1939FA, "CRC-64/XZ check value");
+static_assert(Crc32Bzip2Engine::Check() == 0xFC891918, "CRC-32/BZIP2 check value");
+static_assert(Crc16X25Engine::Check() == 0x906E, "CRC-16/X-25 check value");
+static_assert(Crc16GenibusEngine::Check() == 0xD64E, "CRC-16/GENIBUS check value");
+static_assert(Crc32Engine::SelfTest(), "CRC-32 tables");
+static_assert(Crc32cEngine::SelfTest(), "CRC-32C tables");
+static_assert(Crc64Engine::SelfTest(), "CRC-64/XZ tables");
+static_assert(Crc32Bzip2Engine::SelfTest(), "CRC-32/BZIP2 tables");
+static_assert(Crc16X25Engine::SelfTest(), "CRC-16/X-25 tables");
+static_assert(Crc16GenibusEngine::SelfTest(), "CRC-16/GENIBUS tables");
@@ -0,0 +1,72 @@
+#pragma once
+
+// Carry-less multiply folding for reflected CRCs of any width, shared by the PCLMULQDQ kernels.
+// x86-64 only: include it after checking CRC64_USE_PCLMUL (crc64.h) or the equivalent.
+
+#include "crcengine.h"
+
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_PCLMUL __attribute__((target("pclmul,sse2")))
+#else
+#define TARGET_PCLMUL
+#endif
+
+namespace CrcFold {
+
+    /// x^n mod P, highest power first
+    template <typename Engine>
+    constexpr uint64_t XPowMod(unsigned n) {
+        const uint64_t mask = ~(uint64_t)0 >> (64 - Engine::Bits);
+        uint64_t result = 1;
+        for (unsigned i = 0; i < n; i++) {
+            bool carry = (result >> (Engine::Bits - 1)) & 1;
+            result = ((result << 1) & mask) ^ (carry ? Engine::Normal & mask : 0);
+        }
+        return result;
+    }
+
+    /// multipliers that move a 16 byte register bits further along the message
+    // a little endian load of reflected data holds x^127 in bit 0: the low half needs x^(bits+64) mod P,
+    // the high half x^bits mod P, and both lose one power because the carry-less product of two
+    // reflected 64 bit values comes out shifted by one bit
+    struct Constant {
+        uint64_t low;
+        uint64_t high;
+    };
+
+    template <typename Engine>
+    constexpr Constant By(unsigned bits) {
+        return { CrcDetail::Reflect<uint64_t>(XPowMod<Engine>(bits + 63), 64), CrcDetail::Reflect<uint64_t>(XPowMod<Engine>(bits - 1), 64) };
+    }
+
+    TARGET_PCLMUL inline __m128i Multiplier(const Constant& constant) {
+        return _mm_set_epi64x((long long)constant.high, (long long)constant.low);
+    }
+
+    TARGET_PCLMUL inline __m128i Fold(__m128i value, __m128i multiplier) {
+        return _mm_xor_si128(
+            _mm_clmulepi64_si128(value, multiplier, 0x00),
+            _mm_clmulepi64_si128(value, multiplier, 0x11));
+    }
+
+    TARGET_PCLMUL inline __m128i Load(const uint8_t* data) {
+        return _mm_loadu_si128((const __m128i*)data);
+    }
+
+    /// the 16 bytes a CRC register is added to before folding the first block
+    template <typename Engine>
+    TARGET_PCLMUL inline __m128i Start(typename Engine::Value previous) {
+        return _mm_cvtsi64_si128((long long)(uint64_t)(~previous & Engine::Mask));
+    }
+
+    /// CRC of everything folded into a register: it leaves the same remainder as the data
+    /// it replaces, so the table driven code finishes it starting from a zero register
+    template <typename Engine>
+    typename Engine::Value Finish(const uint8_t folded[16]) {
+        return Engine::Update(folded, 16, Engine::Mask);
+    }
+
+} // namespace CrcFold
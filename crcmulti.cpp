@@ -0,0 +1,222 @@
+#include "crcmulti.h"
+#include "crcengine.h"
+#include "cpufeatures.h"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRCMULTI_USE_PCLMUL
+#include "crcfold.h"
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_VPCLMUL_AVX2 __attribute__((target("vpclmulqdq,pclmul,avx2")))
+#define TARGET_VPCLMUL_AVX512 __attribute__((target("vpclmulqdq,pclmul,avx512f")))
+#else
+#define TARGET_VPCLMUL_AVX2
+#define TARGET_VPCLMUL_AVX512
+#endif
+#endif
+
+namespace {
+
+/// shorter buffers are left to UpdateChecksum, the lanes only pay off after a few blocks
+const size_t MinLaneLength = 64;
+
+#ifdef CRCMULTI_USE_PCLMUL
+
+/// folds the first length bytes (a multiple of 16) of every lane's buffer into its 16 byte register,
+/// registers hold the CRC to continue from on input
+typedef void (*LaneKernel)(const uint8_t* const* data, size_t length, const CrcFold::Constant& fold, uint8_t* registers);
+
+struct LaneKernelInfo {
+    int lanes;
+    LaneKernel kernel;
+};
+
+/// 4 lanes in 4 xmm registers
+TARGET_PCLMUL void FoldLanes4(const uint8_t* const* data, size_t length, const CrcFold::Constant& fold, uint8_t* registers) {
+    __m128i multiplier = CrcFold::Multiplier(fold);
+    __m128i lane0 = _mm_xor_si128(CrcFold::Load(registers), CrcFold::Load(data[0]));
+    __m128i lane1 = _mm_xor_si128(CrcFold::Load(registers + 16), CrcFold::Load(data[1]));
+    __m128i lane2 = _mm_xor_si128(CrcFold::Load(registers + 32), CrcFold::Load(data[2]));
+    __m128i lane3 = _mm_xor_si128(CrcFold::Load(registers + 48), CrcFold::Load(data[3]));
+
+    for (size_t offset = 16; offset < length; offset += 16) {
+        lane0 = _mm_xor_si128(CrcFold::Fold(lane0, multiplier), CrcFold::Load(data[0] + offset));
+        lane1 = _mm_xor_si128(CrcFold::Fold(lane1, multiplier), CrcFold::Load(data[1] + offset));
+        lane2 = _mm_xor_si128(CrcFold::Fold(lane2, multiplier), CrcFold::Load(data[2] + offset));
+        lane3 = _mm_xor_si128(CrcFold::Fold(lane3, multiplier), CrcFold::Load(data[3] + offset));
+    }
+
+    _mm_storeu_si128((__m128i*)registers, lane0);
+    _mm_storeu_si128((__m128i*)(registers + 16), lane1);
+    _mm_storeu_si128((__m128i*)(registers + 32), lane2);
+    _mm_storeu_si128((__m128i*)(registers + 48), lane3);
+}
+
+/// 16 bytes of two buffers in one ymm register
+TARGET_VPCLMUL_AVX2 inline __m256i Load2(const uint8_t* const* data, size_t offset) {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(CrcFold::Load(data[0] + offset)), CrcFold::Load(data[1] + offset), 1);
+}
+
+TARGET_VPCLMUL_AVX2 inline __m256i Fold2(__m256i value, __m256i multiplier, const uint8_t* const* data, size_t offset) {
+    __m256i folded = _mm256_xor_si256(
+        _mm256_clmulepi64_epi128(value, multiplier, 0x00),
+        _mm256_clmulepi64_epi128(value, multiplier, 0x11));
+    return _mm256_xor_si256(folded, Load2(data, offset));
+}
+
+/// 8 lanes in 4 ymm registers
+TARGET_VPCLMUL_AVX2 void FoldLanes8(const uint8_t* const* data, size_t length, const CrcFold::Constant& fold, uint8_t* registers) {
+    __m256i multiplier = _mm256_broadcastsi128_si256(_mm_set_epi64x((long long)fold.high, (long long)fold.low));
+    __m256i lane0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)registers), Load2(data, 0));
+    __m256i lane1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(registers + 32)), Load2(data + 2, 0));
+    __m256i lane2 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(registers + 64)), Load2(data + 4, 0));
+    __m256i lane3 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(registers + 96)), Load2(data + 6, 0));
+
+    for (size_t offset = 16; offset < length; offset += 16) {
+        lane0 = Fold2(lane0, multiplier, data, offset);
+        lane1 = Fold2(lane1, multiplier, data + 2, offset);
+        lane2 = Fold2(lane2, multiplier, data + 4, offset);
+        lane3 = Fold2(lane3, multiplier, data + 6, offset);
+    }
+
+    _mm256_storeu_si256((__m256i*)registers, lane0);
+    _mm256_storeu_si256((__m256i*)(registers + 32), lane1);
+    _mm256_storeu_si256((__m256i*)(registers + 64), lane2);
+    _mm256_storeu_si256((__m256i*)(registers + 96), lane3);
+}
+
+/// 16 bytes of four buffers in one zmm register
+TARGET_VPCLMUL_AVX512 inline __m512i Load4(const uint8_t* const* data, size_t offset) {
+    __m512i value = _mm512_castsi128_si512(CrcFold::Load(data[0] + offset));
+    value = _mm512_inserti32x4(value, CrcFold::Load(data[1] + offset), 1);
+    value = _mm512_inserti32x4(value, CrcFold::Load(data[2] + offset), 2);
+    return _mm512_inserti32x4(value, CrcFold::Load(data[3] + offset), 3);
+}
+
+TARGET_VPCLMUL_AVX512 inline __m512i Fold4(__m512i value, __m512i multiplier, const uint8_t* const* data, size_t offset) {
+    __m512i folded = _mm512_xor_si512(
+        _mm512_clmulepi64_epi128(value, multiplier, 0x00),
+        _mm512_clmulepi64_epi128(value, multiplier, 0x11));
+    return _mm512_xor_si512(folded, Load4(data, offset));
+}
+
+/// 16 lanes in 4 zmm registers
+TARGET_VPCLMUL_AVX512 void FoldLanes16(const uint8_t* const* data, size_t length, const CrcFold::Constant& fold, uint8_t* registers) {
+    // set rather than _mm512_broadcast_i32x4, whose undefined upper half GCC warns about
+    long long high = (long long)fold.high, low = (long long)fold.low;
+    __m512i multiplier = _mm512_set_epi64(high, low, high, low, high, low, high, low);
+    __m512i lane0 = _mm512_xor_si512(_mm512_loadu_si512(registers), Load4(data, 0));
+    __m512i lane1 = _mm512_xor_si512(_mm512_loadu_si512(registers + 64), Load4(data + 4, 0));
+    __m512i lane2 = _mm512_xor_si512(_mm512_loadu_si512(registers + 128), Load4(data + 8, 0));
+    __m512i lane3 = _mm512_xor_si512(_mm512_loadu_si512(registers + 192), Load4(data + 12, 0));
+
+    for (size_t offset = 16; offset < length; offset += 16) {
+        lane0 = Fold4(lane0, multiplier, data, offset);
+        lane1 = Fold4(lane1, multiplier, data + 4, offset);
+        lane2 = Fold4(lane2, multiplier, data + 8, offset);
+        lane3 = Fold4(lane3, multiplier, data + 12, offset);
+    }
+
+    _mm512_storeu_si512(registers, lane0);
+    _mm512_storeu_si512(registers + 64, lane1);
+    _mm512_storeu_si512(registers + 128, lane2);
+    _mm512_storeu_si512(registers + 192, lane3);
+}
+
+/// kernels this CPU supports, widest first
+const std::vector<LaneKernelInfo>& LaneKernels() {
+    static const std::vector<LaneKernelInfo> kernels = []() {
+        const CpuFeatures& cpu = CpuFeatures::Get();
+        std::vector<LaneKernelInfo> result;
+        if (cpu.vpclmulqdq && cpu.avx512f) {
+            result.push_back({ 16, FoldLanes16 });
+        }
+        if (cpu.vpclmulqdq && cpu.avx2) {
+            result.push_back({ 8, FoldLanes8 });
+        }
+        if (cpu.pclmul) {
+            result.push_back({ 4, FoldLanes4 });
+        }
+        return result;
+    }();
+    return kernels;
+}
+
+/// hash one job per lane, the shortest comes first: all lanes fold as many whole blocks as it has,
+/// the rest of every buffer is finished on its own
+template <typename Engine>
+void HashGroup(ChecksumType type, ChecksumJob* const* group, const LaneKernelInfo& info) {
+    const CrcFold::Constant Fold128 = CrcFold::By<Engine>(128);
+
+    size_t common = group[0]->length & ~(size_t)15;
+    const uint8_t* data[16];
+    alignas(64) uint8_t registers[16 * 16] = {};
+    for (int i = 0; i < info.lanes; i++) {
+        data[i] = (const uint8_t*)group[i]->data;
+        // the register is added to the first bytes, little endian
+        uint64_t start = (uint64_t)(~(typename Engine::Value)group[i]->checksum & Engine::Mask);
+        memcpy(registers + 16 * i, &start, sizeof(start));
+    }
+
+    info.kernel(data, common, Fold128, registers);
+
+    for (int i = 0; i < info.lanes; i++) {
+        uint64_t crc = CrcFold::Finish<Engine>(registers + 16 * i);
+        group[i]->checksum = UpdateChecksum(type, data[i] + common, group[i]->length - common, crc);
+    }
+}
+
+template <typename Engine>
+void HashLanes(ChecksumType type, ChecksumJob* jobs, size_t count) {
+    std::vector<ChecksumJob*> sorted;
+    for (size_t i = 0; i < count; i++) {
+        if (jobs[i].length >= MinLaneLength) {
+            sorted.push_back(&jobs[i]);
+        } else {
+            jobs[i].checksum = UpdateChecksum(type, jobs[i].data, jobs[i].length, jobs[i].checksum);
+        }
+    }
+    // neighbours have similar lengths, so little is left over after the common part
+    std::sort(sorted.begin(), sorted.end(), [](const ChecksumJob* a, const ChecksumJob* b) { return a->length < b->length; });
+
+    size_t next = 0;
+    for (const LaneKernelInfo& info : LaneKernels()) {
+        for (; next + info.lanes <= sorted.size(); next += info.lanes) {
+            HashGroup<Engine>(type, &sorted[next], info);
+        }
+    }
+    for (; next < sorted.size(); next++) {
+        sorted[next]->checksum = UpdateChecksum(type, sorted[next]->data, sorted[next]->length, sorted[next]->checksum);
+    }
+}
+
+#endif
+
+} // anonymous namespace
+
+void UpdateChecksums(ChecksumType type, ChecksumJob* jobs, size_t count) {
+#ifdef CRCMULTI_USE_PCLMUL
+    switch (type) {
+    case ChecksumType::Crc32: return HashLanes<Crc32Engine>(type, jobs, count);
+    case ChecksumType::Crc32c: return HashLanes<Crc32cEngine>(type, jobs, count);
+    case ChecksumType::Crc64: return HashLanes<Crc64Engine>(type, jobs, count);
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].checksum = UpdateChecksum(type, jobs[i].data, jobs[i].length, jobs[i].checksum);
+    }
+}
+
+int ChecksumLanes() {
+#ifdef CRCMULTI_USE_PCLMUL
+    if (!LaneKernels().empty()) {
+        return LaneKernels().front().lanes;
+    }
+#endif
+    return 1;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Multi-buffer hashing: many short independent buffers are folded at once, one buffer
+// per 128 bit lane (4 lanes with PCLMULQDQ, 8 or 16 with VPCLMULQDQ on AVX2 / AVX-512).
+// A single small file never gets far enough into crc32_fast to hide its latencies,
+// a group of them keeps the carry-less multipliers busy.
+
+#include "checksum.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// one buffer for UpdateChecksums, checksum is the previous value on input (0 to start) and the result on output
+struct ChecksumJob {
+    const void* data;
+    size_t length;
+    uint64_t checksum;
+};
+
+/// same as UpdateChecksum for every job, buffers of similar length are hashed side by side
+void UpdateChecksums(ChecksumType type, ChecksumJob* jobs, size_t count);
+
+/// number of buffers UpdateChecksums hashes at once on this CPU, 1 without carry-less multiply
+int ChecksumLanes();
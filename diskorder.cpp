@@ -0,0 +1,211 @@
+#include "diskorder.h"
+
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#include <winioctl.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+/// number of the device holding path, false if the file can't be looked at
+bool DeviceOf(const std::filesystem::path& path, uint64_t& device) {
+#ifdef _WIN32
+    wchar_t volume[MAX_PATH + 1];
+    DWORD serial = 0;
+    if (!GetVolumePathNameW(path.c_str(), volume, MAX_PATH + 1) || !GetVolumeInformationW(volume, NULL, 0, &serial, NULL, NULL, NULL, 0)) {
+        return false;
+    }
+    device = serial;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    device = (uint64_t)info.st_dev;
+#endif
+    return true;
+}
+
+} // anonymous namespace
+
+bool FirstPhysicalOffset(const std::filesystem::path& path, uint64_t& offset) {
+#if defined(__linux__)
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    // room for the header and a single extent, only the first one is of interest
+    union {
+        struct fiemap map;
+        uint8_t bytes[sizeof(struct fiemap) + sizeof(struct fiemap_extent)];
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.map.fm_start = 0;
+    request.map.fm_length = FIEMAP_MAX_OFFSET;
+    request.map.fm_extent_count = 1;
+    bool found = ioctl(fd, FS_IOC_FIEMAP, &request.map) == 0 && request.map.fm_mapped_extents == 1;
+    close(fd);
+    // data waiting for delayed allocation or kept in the inode has no place of its own yet
+    const uint32_t Unplaced = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE;
+    if (!found || (request.map.fm_extents[0].fe_flags & Unplaced)) {
+        return false;
+    }
+    offset = request.map.fm_extents[0].fe_physical;
+    return true;
+#elif defined(_WIN32)
+    wchar_t volume[MAX_PATH + 1];
+    DWORD sectorsPerCluster, bytesPerSector, freeClusters, totalClusters;
+    if (!GetVolumePathNameW(path.c_str(), volume, MAX_PATH + 1) ||
+        !GetDiskFreeSpaceW(volume, &sectorsPerCluster, &bytesPerSector, &freeClusters, &totalClusters)) {
+        return false;
+    }
+    HANDLE file = CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    STARTING_VCN_INPUT_BUFFER input{};
+    RETRIEVAL_POINTERS_BUFFER output{};
+    DWORD bytes = 0;
+    // ERROR_MORE_DATA only means the file has more extents than the one asked for
+    BOOL done = DeviceIoControl(file, FSCTL_GET_RETRIEVAL_POINTERS, &input, sizeof(input), &output, sizeof(output), &bytes, NULL);
+    bool found = (done || GetLastError() == ERROR_MORE_DATA) && output.ExtentCount > 0;
+    CloseHandle(file);
+    // an LCN of -1 is a hole or compressed data, files small enough for the MFT have no extents
+    if (!found || output.Extents[0].Lcn.QuadPart < 0) {
+        return false;
+    }
+    offset = (uint64_t)output.Extents[0].Lcn.QuadPart * sectorsPerCluster * bytesPerSector;
+    return true;
+#else
+    (void)path;
+    (void)offset;
+    return false;
+#endif
+}
+
+bool IsRotational(const std::filesystem::path& path) {
+#if defined(__linux__)
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    std::error_code ec{};
+    std::filesystem::path device = std::filesystem::canonical(
+        "/sys/dev/block/" + std::to_string(major(info.st_dev)) + ":" + std::to_string(minor(info.st_dev)), ec);
+    if (ec) {
+        // network and virtual file systems
+        return false;
+    }
+    // a partition has no queue of its own, the disk it is on does
+    for (const std::filesystem::path& disk : { device, device.parent_path() }) {
+        int rotational;
+        if (std::ifstream(disk / "queue" / "rotational") >> rotational) {
+            return rotational != 0;
+        }
+    }
+    return false;
+#elif defined(_WIN32)
+    wchar_t mountPoint[MAX_PATH + 1];
+    wchar_t volume[MAX_PATH + 1];
+    if (!GetVolumePathNameW(path.c_str(), mountPoint, MAX_PATH + 1) ||
+        !GetVolumeNameForVolumeMountPointW(mountPoint, volume, MAX_PATH + 1)) {
+        return false;
+    }
+    // \\?\Volume{GUID}\ names the root directory, without the backslash it names the volume
+    volume[wcslen(volume) - 1] = L'\0';
+    HANDLE device = CreateFileW(volume, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    if (device == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    STORAGE_PROPERTY_QUERY query{};
+    query.PropertyId = StorageDeviceSeekPenaltyProperty;
+    query.QueryType = PropertyStandardQuery;
+    DEVICE_SEEK_PENALTY_DESCRIPTOR penalty{};
+    DWORD bytes = 0;
+    BOOL done = DeviceIoControl(device, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query), &penalty, sizeof(penalty), &bytes, NULL);
+    CloseHandle(device);
+    return done && bytes >= sizeof(penalty) && penalty.IncursSeekPenalty;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+void SortByDiskOffset(std::vector<std::filesystem::path>& files, bool onlyRotational,
+    std::vector<std::vector<size_t>>* sweeps) {
+    struct Entry {
+        size_t device;
+        bool known;
+        uint64_t offset;
+        size_t index;
+    };
+    std::vector<Entry> entries;
+    std::vector<size_t> slots;
+    // devices by number in order of appearance, and whether their files are sorted
+    std::map<uint64_t, size_t> devices;
+    std::vector<bool> sorted;
+    for (size_t i = 0; i < files.size(); i++) {
+        uint64_t number;
+        if (!DeviceOf(files[i], number)) {
+            continue;
+        }
+        auto found = devices.find(number);
+        if (found == devices.end()) {
+            found = devices.emplace(number, sorted.size()).first;
+            sorted.push_back(!onlyRotational || IsRotational(files[i]));
+        }
+        if (!sorted[found->second]) {
+            continue;
+        }
+        Entry entry{ found->second, false, 0, i };
+        entry.known = FirstPhysicalOffset(files[i], entry.offset);
+        entries.push_back(entry);
+        slots.push_back(i);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        if (a.device != b.device) {
+            return a.device < b.device;
+        }
+        if (a.known != b.known) {
+            return a.known;
+        }
+        return a.known && a.offset != b.offset ? a.offset < b.offset : a.index < b.index;
+    });
+
+    // the files of sorted devices are rearranged among the places they had, the others don't move
+    std::vector<std::filesystem::path> previous(files.size());
+    for (size_t slot : slots) {
+        previous[slot] = std::move(files[slot]);
+    }
+    for (size_t k = 0; k < slots.size(); k++) {
+        files[slots[k]] = std::move(previous[entries[k].index]);
+    }
+    if (sweeps) {
+        sweeps->clear();
+        for (size_t k = 0; k < slots.size(); k++) {
+            if (k == 0 || entries[k].device != entries[k - 1].device) {
+                sweeps->emplace_back();
+            }
+            sweeps->back().push_back(slots[k]);
+        }
+    }
+}
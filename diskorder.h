@@ -0,0 +1,26 @@
+#pragma once
+
+// Reading files in the order of their place on the disk. On a spinning disk every jump to
+// another file costs a seek of several milliseconds, so a list of small and medium files in
+// directory or drop order is read at a few MB/s. Sorted by the physical offset of their first
+// extent (FIEMAP on Linux, FSCTL_GET_RETRIEVAL_POINTERS on Windows) they are read in one sweep
+// of the head from the start of the disk to the end, like an elevator.
+
+#include <stdint.h>
+#include <filesystem>
+#include <vector>
+
+/// byte offset on its device at which the file's data starts;
+/// false if unknown: empty, stored inside its inode, not yet allocated, or not supported here
+bool FirstPhysicalOffset(const std::filesystem::path& path, uint64_t& offset);
+
+/// whether the device holding path has to seek (a hard disk), false if unknown
+bool IsRotational(const std::filesystem::path& path);
+
+/// sort files into one ascending sweep per device, devices in the order they first appear;
+/// files with an unknown offset follow the others of their device in their previous order.
+/// With onlyRotational files on devices that don't seek keep their places.
+/// sweeps receives the indices of the sorted files, one list per device in reading order; the
+/// sweep only pays off if a single reader works through each list while nobody else reads the device
+void SortByDiskOffset(std::vector<std::filesystem::path>& files, bool onlyRotational,
+    std::vector<std::vector<size_t>>* sweeps = nullptr);
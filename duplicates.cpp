@@ -0,0 +1,314 @@
+#include "duplicates.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+const int PartitionBits = 8;
+const size_t PartitionCount = (size_t)1 << PartitionBits;
+
+/// tables grow before they are fuller than this
+const double MaxLoad = 0.7;
+
+/// lists shorter than this aren't worth starting threads for
+const size_t ParallelBuildSize = 64 * 1024;
+
+/// splitmix64 finalizer over both halves of the key
+uint64_t KeyHash(uint64_t size, uint64_t checksum) {
+    uint64_t x = size * 0x9E3779B97F4A7C15ull ^ checksum;
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// the top bits pick the partition, the low bits the slot, the bits in between are the fingerprint
+size_t PartitionOf(uint64_t hash) {
+    return (size_t)(hash >> (64 - PartitionBits));
+}
+
+uint32_t FingerprintOf(uint64_t hash) {
+    return (uint32_t)(hash >> 24);
+}
+
+/// power of two with room for count classes
+size_t TableSize(size_t count) {
+    size_t size = 16;
+    while (size * MaxLoad < count + 1) {
+        size *= 2;
+    }
+    return size;
+}
+
+/// slot of the class with this key, or the free slot where it belongs
+template <typename Slot>
+size_t Probe(const std::vector<Slot>& slots, uint64_t hash, uint64_t size, uint64_t checksum,
+    const uint64_t* sizes, const uint64_t* checksums) {
+    size_t mask = slots.size() - 1;
+    uint32_t fingerprint = FingerprintOf(hash);
+    for (size_t slot = (size_t)hash & mask; ; slot = (slot + 1) & mask) {
+        const Slot& candidate = slots[slot];
+        if (candidate.cls == DuplicateIndex::None ||
+            (candidate.fingerprint == fingerprint && sizes[candidate.cls] == size && checksums[candidate.cls] == checksum)) {
+            return slot;
+        }
+    }
+}
+
+/// run work(thread) on count threads, the calling thread being the last one
+void RunThreads(unsigned count, const std::function<void(unsigned)>& work) {
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t + 1 < count; t++) {
+        threads.emplace_back(work, t);
+    }
+    work(count - 1);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+} // anonymous namespace
+
+void DuplicateIndex::Set(uint32_t entry, uint64_t size, uint64_t checksum) {
+    if (entry >= classOf.size()) {
+        classOf.resize((size_t)entry + 1, None);
+    }
+    uint32_t cls = FindOrAdd(size, checksum);
+    if (classOf[entry] != cls) {
+        Leave(entry);
+        Join(entry, cls);
+    }
+}
+
+void DuplicateIndex::Reset(uint32_t entry) {
+    if (entry < classOf.size()) {
+        Leave(entry);
+    }
+}
+
+void DuplicateIndex::Build(const uint64_t* sizes, const uint64_t* checksums, size_t count) {
+    Clear();
+    if (count >= None) {
+        throw std::length_error("too many entries");
+    }
+    classOf.assign(count, None);
+    partitions.resize(PartitionCount);
+    unsigned threadCount = count < ParallelBuildSize ? 1 : std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk = (count + threadCount - 1) / threadCount;
+
+    // radix partitioning: count per thread and partition, then every thread scatters its part
+    // of the entries to the places the counts give it, in order; the keys go along, so that
+    // grouping reads them one after the other instead of all over the input
+    std::vector<size_t> cursor((size_t)threadCount * PartitionCount, 0);
+    RunThreads(threadCount, [&](unsigned t) {
+        size_t* counts = &cursor[(size_t)t * PartitionCount];
+        for (size_t i = t * chunk; i < std::min(count, (t + 1) * chunk); i++) {
+            counts[PartitionOf(KeyHash(sizes[i], checksums[i]))]++;
+        }
+    });
+    std::vector<size_t> partitionStart(PartitionCount + 1);
+    size_t position = 0;
+    for (size_t p = 0; p < PartitionCount; p++) {
+        partitionStart[p] = position;
+        for (unsigned t = 0; t < threadCount; t++) {
+            size_t n = cursor[(size_t)t * PartitionCount + p];
+            cursor[(size_t)t * PartitionCount + p] = position;
+            position += n;
+        }
+    }
+    partitionStart[PartitionCount] = position;
+    std::vector<uint32_t> order(count);
+    std::vector<uint64_t> orderedSizes(count);
+    std::vector<uint64_t> orderedChecksums(count);
+    RunThreads(threadCount, [&](unsigned t) {
+        size_t* next = &cursor[(size_t)t * PartitionCount];
+        for (size_t i = t * chunk; i < std::min(count, (t + 1) * chunk); i++) {
+            size_t k = next[PartitionOf(KeyHash(sizes[i], checksums[i]))]++;
+            order[k] = (uint32_t)i;
+            orderedSizes[k] = sizes[i];
+            orderedChecksums[k] = checksums[i];
+        }
+    });
+    // class of each entry in partitioned order, numbered within its partition at first
+    std::vector<uint32_t> orderedClasses(count);
+
+    // every partition is grouped on its own, numbering its classes from 0
+    struct Local {
+        std::vector<uint64_t> size;
+        std::vector<uint64_t> checksum;
+        std::vector<uint32_t> count;
+        uint64_t wastedBytes = 0;
+        size_t duplicateClasses = 0;
+    };
+    std::vector<Local> locals(PartitionCount);
+    std::atomic<size_t> nextPartition{ 0 };
+    RunThreads(threadCount, [&](unsigned) {
+        for (size_t p; (p = nextPartition++) < PartitionCount; ) {
+            Partition& partition = partitions[p];
+            Local& local = locals[p];
+            partition.slots.assign(TableSize(partitionStart[p + 1] - partitionStart[p]), Slot{ 0, None });
+            for (size_t k = partitionStart[p]; k < partitionStart[p + 1]; k++) {
+                uint64_t size = orderedSizes[k];
+                uint64_t checksum = orderedChecksums[k];
+                uint64_t hash = KeyHash(size, checksum);
+                size_t slot = Probe(partition.slots, hash, size, checksum, local.size.data(), local.checksum.data());
+                if (partition.slots[slot].cls == None) {
+                    partition.slots[slot] = { FingerprintOf(hash), (uint32_t)local.size.size() };
+                    partition.used++;
+                    local.size.push_back(size);
+                    local.checksum.push_back(checksum);
+                    local.count.push_back(0);
+                }
+                uint32_t cls = partition.slots[slot].cls;
+                if (++local.count[cls] >= 2) {
+                    local.wastedBytes += size;
+                    local.duplicateClasses += local.count[cls] == 2;
+                }
+                orderedClasses[k] = cls;
+            }
+        }
+    });
+
+    // then the partitions' classes are laid out one after the other and renumbered
+    std::vector<uint32_t> base(PartitionCount);
+    size_t classes = 0;
+    for (size_t p = 0; p < PartitionCount; p++) {
+        base[p] = (uint32_t)classes;
+        classes += locals[p].size.size();
+        wastedBytes += locals[p].wastedBytes;
+        duplicateClasses += locals[p].duplicateClasses;
+    }
+    classSize.resize(classes);
+    classChecksum.resize(classes);
+    classCount.resize(classes);
+    nextPartition = 0;
+    RunThreads(threadCount, [&](unsigned) {
+        for (size_t p; (p = nextPartition++) < PartitionCount; ) {
+            Local& local = locals[p];
+            std::copy(local.size.begin(), local.size.end(), classSize.begin() + base[p]);
+            std::copy(local.checksum.begin(), local.checksum.end(), classChecksum.begin() + base[p]);
+            std::copy(local.count.begin(), local.count.end(), classCount.begin() + base[p]);
+            local = Local{};
+            for (Slot& slot : partitions[p].slots) {
+                if (slot.cls != None) {
+                    slot.cls += base[p];
+                }
+            }
+            for (size_t k = partitionStart[p]; k < partitionStart[p + 1]; k++) {
+                classOf[order[k]] = orderedClasses[k] + base[p];
+            }
+        }
+    });
+}
+
+void DuplicateIndex::Clear() {
+    classOf.clear();
+    classSize.clear();
+    classChecksum.clear();
+    classCount.clear();
+    partitions.clear();
+    wastedBytes = 0;
+    duplicateClasses = 0;
+}
+
+void DuplicateIndex::ListDuplicates(std::vector<uint32_t>& classes, std::vector<size_t>& starts, std::vector<uint32_t>& entries) const {
+    // the sort keys are copied next to the class, comparing them doesn't look up three arrays
+    struct Ranked {
+        uint64_t wasted;
+        uint64_t size;
+        uint64_t checksum;
+        uint32_t cls;
+    };
+    std::vector<Ranked> ranked;
+    ranked.reserve(duplicateClasses);
+    for (uint32_t cls = 0; cls < classCount.size(); cls++) {
+        if (classCount[cls] >= 2) {
+            ranked.push_back({ classSize[cls] * (classCount[cls] - 1), classSize[cls], classChecksum[cls], cls });
+        }
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const Ranked& a, const Ranked& b) {
+        if (a.wasted != b.wasted) {
+            return a.wasted > b.wasted;
+        }
+        return a.size != b.size ? a.size > b.size : a.checksum < b.checksum;
+    });
+    classes.resize(ranked.size());
+    for (size_t k = 0; k < ranked.size(); k++) {
+        classes[k] = ranked[k].cls;
+    }
+    ranked = std::vector<Ranked>();
+
+    // counting sort of the entries by the rank of their class
+    std::vector<uint32_t> rank(classCount.size(), None);
+    starts.assign(classes.size() + 1, 0);
+    for (size_t k = 0; k < classes.size(); k++) {
+        rank[classes[k]] = (uint32_t)k;
+        starts[k + 1] = starts[k] + classCount[classes[k]];
+    }
+    entries.resize(starts.back());
+    std::vector<size_t> next(starts.begin(), starts.end() - 1);
+    for (uint32_t entry = 0; entry < classOf.size(); entry++) {
+        if (classOf[entry] != None && rank[classOf[entry]] != None) {
+            entries[next[rank[classOf[entry]]]++] = entry;
+        }
+    }
+}
+
+uint32_t DuplicateIndex::FindOrAdd(uint64_t size, uint64_t checksum) {
+    if (partitions.empty()) {
+        partitions.resize(PartitionCount);
+    }
+    uint64_t hash = KeyHash(size, checksum);
+    Partition& partition = partitions[PartitionOf(hash)];
+    if (partition.used + 1 > partition.slots.size() * MaxLoad) {
+        // twice the size, the classes are found again by the hash of their key
+        std::vector<Slot> slots(std::max<size_t>(16, 2 * partition.slots.size()), Slot{ 0, None });
+        for (const Slot& slot : partition.slots) {
+            if (slot.cls != None) {
+                uint64_t rehash = KeyHash(classSize[slot.cls], classChecksum[slot.cls]);
+                slots[Probe(slots, rehash, classSize[slot.cls], classChecksum[slot.cls], classSize.data(), classChecksum.data())] = slot;
+            }
+        }
+        partition.slots = std::move(slots);
+    }
+
+    size_t slot = Probe(partition.slots, hash, size, checksum, classSize.data(), classChecksum.data());
+    if (partition.slots[slot].cls == None) {
+        if (classSize.size() >= None) {
+            throw std::length_error("too many classes");
+        }
+        partition.slots[slot] = { FingerprintOf(hash), (uint32_t)classSize.size() };
+        partition.used++;
+        classSize.push_back(size);
+        classChecksum.push_back(checksum);
+        classCount.push_back(0);
+    }
+    return partition.slots[slot].cls;
+}
+
+void DuplicateIndex::Join(uint32_t entry, uint32_t cls) {
+    classOf[entry] = cls;
+    if (++classCount[cls] >= 2) {
+        wastedBytes += classSize[cls];
+        duplicateClasses += classCount[cls] == 2;
+    }
+}
+
+void DuplicateIndex::Leave(uint32_t entry) {
+    uint32_t cls = classOf[entry];
+    if (cls == None) {
+        return;
+    }
+    if (classCount[cls] >= 2) {
+        wastedBytes -= classSize[cls];
+        duplicateClasses -= classCount[cls] == 2;
+    }
+    classCount[cls]--;
+    classOf[entry] = None;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// Grouping files into classes of equal size and checksum. Entries (the files, numbered densely
+// from 0 by the caller) only remember their class; the classes keep size, checksum and member
+// count in separate arrays, found through 256 hash tables partitioned by the top byte of the
+// key's hash. A result that arrives is one table lookup (Set), so the classes follow a scan as
+// it runs; a whole list at once (Build) is partitioned by that byte first, radix style, and the
+// partitions are grouped on all threads, each in a table small enough to stay in cache.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct DuplicateIndex {
+    static constexpr uint32_t None = UINT32_MAX;
+
+    /// entry's size and checksum are known, or changed; entries above the highest so far are added
+    void Set(uint32_t entry, uint64_t size, uint64_t checksum);
+
+    /// entry has no result anymore, it leaves its class
+    void Reset(uint32_t entry);
+
+    /// replace everything by entries 0 to count - 1 with these sizes and checksums, on all threads
+    void Build(const uint64_t* sizes, const uint64_t* checksums, size_t count);
+
+    void Clear();
+
+    /// class of entry, None if it has no result
+    uint32_t ClassOf(uint32_t entry) const {
+        return entry < classOf.size() ? classOf[entry] : None;
+    }
+
+    uint32_t Count(uint32_t cls) const {
+        return classCount[cls];
+    }
+
+    uint64_t Size(uint32_t cls) const {
+        return classSize[cls];
+    }
+
+    uint64_t Checksum(uint32_t cls) const {
+        return classChecksum[cls];
+    }
+
+    /// bytes that keeping a single file of every class would free
+    uint64_t WastedBytes() const {
+        return wastedBytes;
+    }
+
+    /// classes with more than one entry
+    size_t DuplicateClasses() const {
+        return duplicateClasses;
+    }
+
+    /// the entries of every class with more than one, class after class, the most wasted bytes first;
+    /// classes[k] holds entries[starts[k]] to entries[starts[k + 1] - 1]
+    void ListDuplicates(std::vector<uint32_t>& classes, std::vector<size_t>& starts, std::vector<uint32_t>& entries) const;
+
+private:
+    /// open addressing, a slot is free if cls is None; the fingerprint saves a look at the class arrays
+    struct Slot {
+        uint32_t fingerprint;
+        uint32_t cls;
+    };
+
+    struct Partition {
+        std::vector<Slot> slots;
+        size_t used = 0;
+    };
+
+    uint32_t FindOrAdd(uint64_t size, uint64_t checksum);
+    void Join(uint32_t entry, uint32_t cls);
+    void Leave(uint32_t entry);
+
+    std::vector<uint32_t> classOf;
+
+    std::vector<uint64_t> classSize;
+    std::vector<uint64_t> classChecksum;
+    std::vector<uint32_t> classCount;
+
+    std::vector<Partition> partitions;
+    uint64_t wastedBytes = 0;
+    size_t duplicateClasses = 0;
+};
@@ -0,0 +1,552 @@
+#include "filehash.h"
+#include "blockmap.h"
+#include "bufferpool.h"
+#include "checkpoint.h"
+#include "crcmulti.h"
+#include "iotuning.h"
+#include "qos.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#ifdef __linux__
+#include "uring.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <winioctl.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// adds the time since construction to a stage counter, if timings are wanted
+struct StageTimer {
+    StageTimer(FileHashTimings* timings, double FileHashTimings::* stage)
+        : timings(timings), stage(stage), start(timings ? Clock::now() : Clock::time_point()) {}
+
+    ~StageTimer() {
+        if (timings) {
+            timings->*stage += std::chrono::duration<double>(Clock::now() - start).count();
+        }
+    }
+
+    FileHashTimings* timings;
+    double FileHashTimings::* stage;
+    Clock::time_point start;
+};
+
+/// bump allocator for the small files of one HashFiles call, kept per thread so that
+/// once it has grown large enough no further allocations are made
+struct Arena {
+    /// make room for size more bytes, offsets handed out so far stay valid
+    void Reserve(size_t size) {
+        if (used + size <= capacity) {
+            return;
+        }
+        size_t newCapacity = std::max(used + size, 2 * capacity);
+        std::unique_ptr<uint8_t[]> newMemory(new uint8_t[newCapacity]);
+        if (used) {
+            memcpy(newMemory.get(), memory.get(), used);
+        }
+        memory = std::move(newMemory);
+        capacity = newCapacity;
+    }
+
+    /// offset of size bytes, after Reserve
+    size_t Allocate(size_t size) {
+        size_t offset = used;
+        used += size;
+        return offset;
+    }
+
+    uint8_t* At(size_t offset) {
+        return memory.get() + offset;
+    }
+
+    std::unique_ptr<uint8_t[]> memory;
+    size_t capacity = 0;
+    size_t used = 0;
+};
+
+/// offset of a file that wasn't read into the arena (too large or failed)
+const size_t NotInArena = SIZE_MAX;
+
+/// read the small files among paths[begin, end) into the arena with ifstream,
+/// offsets receive their position or NotInArena
+void ReadSmallFiles(const std::vector<std::filesystem::path>& paths, size_t begin, size_t end,
+    Arena& arena, std::vector<FileHash>& results, std::vector<size_t>& offsets, FileHashTimings* timings) {
+    for (size_t i = begin; i < end; i++) {
+        std::ifstream file;
+        uint64_t size;
+        {
+            StageTimer timer(timings, &FileHashTimings::open);
+            file.open(paths[i], std::ios::binary | std::ios::ate);
+            if (!file) {
+                results[i].error = L"Failed to open file";
+                continue;
+            }
+            size = (uint64_t)file.tellg();
+        }
+        if (size > SmallFileSize) {
+            continue;
+        }
+
+        StageTimer timer(timings, &FileHashTimings::read);
+        arena.Reserve((size_t)size);
+        size_t offset = arena.Allocate((size_t)size);
+        file.seekg(0, std::ios::beg);
+        AwaitReadBudget(size);
+        Clock::time_point start = Clock::now();
+        file.read((char*)arena.At(offset), (std::streamsize)size);
+        RecordReadLatency(std::chrono::duration<double>(Clock::now() - start).count());
+        if (file.bad()) {
+            results[i].error = L"Failed to read file";
+            continue;
+        }
+        // the file may have shrunk since it was opened
+        results[i].size = (uint64_t)file.gcount();
+        offsets[i] = offset;
+    }
+}
+
+#ifdef __linux__
+/// same as ReadSmallFiles with two io_uring submissions for all files instead of
+/// open, lseek, read and close each: first openat and statx, then read and close;
+/// returns false if io_uring isn't usable, nothing was done then
+bool ReadSmallFilesUring(const std::vector<std::filesystem::path>& paths, size_t begin, size_t end,
+    Arena& arena, std::vector<FileHash>& results, std::vector<size_t>& offsets, FileHashTimings* timings) {
+    thread_local IoUring ring(256);
+    if (!ring.Valid() || 2 * (end - begin) > ring.Capacity()) {
+        return false;
+    }
+
+    struct Pending {
+        int fd = -1;
+        int stat = -1;
+        struct statx info;
+        /// completions of the second submission that came back
+        bool read = false;
+        bool closed = false;
+    };
+    thread_local std::vector<Pending> pending;
+    pending.assign(end - begin, Pending{});
+
+    // user data is the index of the file, with the lowest bit telling the two operations apart
+    {
+        StageTimer timer(timings, &FileHashTimings::open);
+        for (size_t i = begin; i < end; i++) {
+            ring.Openat(paths[i].c_str(), O_RDONLY | O_CLOEXEC, 2 * (i - begin));
+            ring.Statx(paths[i].c_str(), STATX_TYPE | STATX_SIZE, &pending[i - begin].info, 2 * (i - begin) + 1);
+        }
+        bool submitted = ring.SubmitAndWait([&](uint64_t userData, int result) {
+            Pending& file = pending[userData / 2];
+            (userData & 1 ? file.stat : file.fd) = result;
+        });
+        if (!submitted) {
+            // every openat the kernel took has reported back; the files that did open are read
+            // again by ReadSmallFiles, their descriptors aren't needed
+            for (const Pending& file : pending) {
+                if (file.fd >= 0) {
+                    close(file.fd);
+                }
+            }
+            return false;
+        }
+    }
+
+    StageTimer timer(timings, &FileHashTimings::read);
+    size_t total = 0;
+    uint32_t reads = 0;
+    for (const Pending& file : pending) {
+        if (file.fd >= 0 && file.stat == 0 && S_ISREG(file.info.stx_mode) && file.info.stx_size <= SmallFileSize) {
+            total += (size_t)file.info.stx_size;
+            reads++;
+        }
+    }
+    arena.Reserve(total);
+    // all reads go to the kernel at once, so they are paid for at once; their latency isn't
+    // that of a single read and is left out of the backoff
+    AwaitReadBudget(total, reads);
+
+    for (size_t i = begin; i < end; i++) {
+        const Pending& file = pending[i - begin];
+        if (file.fd < 0) {
+            results[i].error = L"Failed to open file";
+            continue;
+        }
+        // large files, and the ones statx failed on, are left to HashFile
+        if (file.stat == 0 && S_ISREG(file.info.stx_mode) && file.info.stx_size <= SmallFileSize) {
+            offsets[i] = arena.Allocate((size_t)file.info.stx_size);
+            ring.Read(file.fd, arena.At(offsets[i]), (unsigned)file.info.stx_size, 0, 2 * (i - begin), true);
+        }
+        ring.Close(file.fd, 2 * (i - begin) + 1);
+    }
+    bool submitted = ring.SubmitAndWait([&](uint64_t userData, int result) {
+        size_t i = begin + userData / 2;
+        if (userData & 1) {
+            pending[i - begin].closed = true;
+            return;
+        }
+        pending[i - begin].read = true;
+        if (result < 0) {
+            results[i].error = L"Failed to read file";
+            offsets[i] = NotInArena;
+        } else {
+            // the file may have shrunk since statx
+            results[i].size = (uint64_t)result;
+        }
+    });
+    if (!submitted) {
+        // operations that didn't report back were never taken by the kernel and won't happen:
+        // HashFile reads those files itself, and their descriptors are still open
+        for (size_t i = begin; i < end; i++) {
+            Pending& file = pending[i - begin];
+            if (file.fd < 0) {
+                continue;
+            }
+            if (!file.read) {
+                offsets[i] = NotInArena;
+            }
+            if (!file.closed) {
+                close(file.fd);
+            }
+        }
+    }
+    return true;
+}
+#endif
+
+/// byte range [offset, end) of a file that may hold something other than zeros
+struct DataExtent {
+    uint64_t offset;
+    uint64_t end;
+};
+
+/// files below this size aren't worth asking for their holes
+const uint64_t SparseFileSize = 1024 * 1024;
+
+/// the data extents of a sparse file in order, followed by an empty extent at size so that the
+/// last hole is covered too; stays empty if the file is fully allocated or holes can't be found
+void FindDataExtents(const std::filesystem::path& path, uint64_t size, std::vector<DataExtent>& extents) {
+#if defined(__linux__)
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    // fully allocated files are read as they are, without probing for holes
+    if (fstat(fd, &info) == 0 && (uint64_t)info.st_blocks * 512 < size) {
+        off_t offset = 0;
+        while ((uint64_t)offset < size) {
+            off_t data = lseek(fd, offset, SEEK_DATA);
+            if (data < 0) {
+                if (errno != ENXIO) {
+                    // the file system doesn't know about holes
+                    extents.clear();
+                    close(fd);
+                    return;
+                }
+                // only a hole is left
+                break;
+            }
+            off_t hole = lseek(fd, data, SEEK_HOLE);
+            uint64_t end = hole < 0 ? size : std::min((uint64_t)hole, size);
+            extents.push_back({ (uint64_t)data, end });
+            offset = (off_t)end;
+        }
+        extents.push_back({ size, size });
+    }
+    close(fd);
+#elif defined(_WIN32)
+    DWORD attributes = GetFileAttributesW(path.c_str());
+    if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_SPARSE_FILE)) {
+        return;
+    }
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    FILE_ALLOCATED_RANGE_BUFFER query{};
+    query.Length.QuadPart = (LONGLONG)size;
+    FILE_ALLOCATED_RANGE_BUFFER ranges[64];
+    while (true) {
+        DWORD bytes = 0;
+        BOOL done = DeviceIoControl(file, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query), ranges, sizeof(ranges), &bytes, NULL);
+        if (!done && GetLastError() != ERROR_MORE_DATA) {
+            extents.clear();
+            CloseHandle(file);
+            return;
+        }
+        DWORD count = bytes / sizeof(ranges[0]);
+        for (DWORD i = 0; i < count; i++) {
+            uint64_t offset = (uint64_t)ranges[i].FileOffset.QuadPart;
+            uint64_t end = std::min(offset + (uint64_t)ranges[i].Length.QuadPart, size);
+            extents.push_back({ offset, end });
+        }
+        if (done || count == 0) {
+            break;
+        }
+        // ERROR_MORE_DATA: continue after the last range returned
+        uint64_t next = extents.back().end;
+        query.FileOffset.QuadPart = (LONGLONG)next;
+        query.Length.QuadPart = (LONGLONG)(size - next);
+    }
+    CloseHandle(file);
+    extents.push_back({ size, size });
+#else
+    (void)path;
+    (void)size;
+    (void)extents;
+#endif
+}
+
+static_assert(SmallFileSize <= DefaultBlockSize, "small files are taken for a single block");
+
+/// fills a block map as the file streams by, in pieces of any size
+struct BlockHasher {
+    BlockHasher(ChecksumType type, BlockMap& map) : type(type), map(map) {
+        map.type = type;
+        map.size = 0;
+        map.checksums.clear();
+    }
+
+    /// length bytes of data, or of zeros if data is null
+    void Update(const uint8_t* data, uint64_t length) {
+        map.size += length;
+        while (length) {
+            uint64_t n = std::min(length, map.blockSize - fill);
+            checksum = data ? UpdateChecksumSkipZeros(type, data, (size_t)n, checksum) : ExtendChecksum(type, checksum, n);
+            fill += n;
+            length -= n;
+            if (data) {
+                data += n;
+            }
+            if (fill == map.blockSize) {
+                map.checksums.push_back(checksum);
+                checksum = 0;
+                fill = 0;
+            }
+        }
+    }
+
+    void Finish() {
+        if (fill) {
+            map.checksums.push_back(checksum);
+        }
+    }
+
+    ChecksumType type;
+    BlockMap& map;
+    uint64_t checksum = 0;
+    uint64_t fill = 0;
+};
+
+} // anonymous namespace
+
+std::filesystem::path CanonicalPath(const std::filesystem::path& path, FileHashTimings* timings) {
+    StageTimer timer(timings, &FileHashTimings::canonicalize);
+    std::error_code ec{};
+    std::filesystem::path canonPath = std::filesystem::canonical(path, ec);
+    return ec ? path : canonPath;
+}
+
+FileHash HashFile(const std::filesystem::path& path, ChecksumType type, const HashProgressCallback& progress, FileHashTimings* timings, BlockMap* blocks,
+    HashControl* control) {
+    FileHash result{};
+
+    std::ifstream file;
+    {
+        StageTimer timer(timings, &FileHashTimings::open);
+        file.open(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            result.error = L"Failed to open file";
+            return result;
+        }
+
+        result.size = (uint64_t)file.tellg();
+        file.seekg(0, std::ios::beg);
+    }
+
+    // holes of sparse files are never read, the checksum is advanced over their zeros instead
+    thread_local std::vector<DataExtent> extents;
+    extents.clear();
+    if (result.size >= SparseFileSize) {
+        StageTimer timer(timings, &FileHashTimings::open);
+        FindDataExtents(path, result.size, extents);
+    }
+    if (extents.empty()) {
+        // everything up to the end of the file, even if it has grown since
+        extents.push_back({ 0, UINT64_MAX });
+    }
+
+    // with a block map the file's checksum is combined from the blocks at the end
+    std::unique_ptr<BlockHasher> blockHasher(blocks ? new BlockHasher(type, *blocks) : nullptr);
+
+    // reused from the pool instead of allocated for each file
+    PooledBuffer buffer;
+    // how much to read at once and how many threads may read from this device together
+    DeviceTuner* tuner = TunerForFile(path);
+    uint64_t totalRead = 0;
+
+    // huge files continue where an earlier attempt stopped; a block map needs every block, so it starts over
+    std::string identity;
+    if (!blocks && result.size >= CheckpointFileSize && CheckpointsEnabled()) {
+        identity = FileIdentity(path);
+        HashCheckpoint checkpoint;
+        if (LoadCheckpoint(identity, type, checkpoint) && checkpoint.offset <= result.size) {
+            totalRead = checkpoint.offset;
+            result.crc = checkpoint.checksum;
+            file.seekg((std::streamoff)totalRead, std::ios::beg);
+        }
+    }
+    Clock::time_point lastCheckpoint = Clock::now();
+    auto saveCheckpoint = [&]() {
+        if (!identity.empty()) {
+            SaveCheckpoint(identity, type, { totalRead, result.crc });
+            lastCheckpoint = Clock::now();
+        }
+    };
+
+    for (const DataExtent& extent : extents) {
+        if (extent.end <= totalRead) {
+            // hashed before the checkpoint
+            continue;
+        }
+        if (extent.offset > totalRead) {
+            {
+                StageTimer timer(timings, &FileHashTimings::hash);
+                if (blockHasher) {
+                    blockHasher->Update(nullptr, extent.offset - totalRead);
+                } else {
+                    result.crc = ExtendChecksum(type, result.crc, extent.offset - totalRead);
+                }
+                totalRead = extent.offset;
+            }
+            file.seekg((std::streamoff)totalRead, std::ios::beg);
+            if (progress) {
+                progress(totalRead, result.size);
+            }
+        }
+
+        while (file && totalRead < extent.end) {
+            if (control && control->Interrupted()) {
+                saveCheckpoint();
+                if (!control->WaitWhilePaused()) {
+                    result.error = CancelledError;
+                    return result;
+                }
+            }
+
+            size_t read;
+            {
+                StageTimer timer(timings, &FileHashTimings::read);
+                // paid before taking one of the device's reads, so a throttled thread doesn't hold
+                // it while it sleeps
+                size_t length = (size_t)std::min<uint64_t>(std::min(NextReadSize(tuner), buffer.size), extent.end - totalRead);
+                if (AwaitReadBudget(length)) {
+                    RestartInterval(tuner);
+                }
+                length = std::min(length, BeginRead(tuner));
+                Clock::time_point start = Clock::now();
+                file.read((char*)buffer.data, (std::streamsize)length);
+                read = (size_t)file.gcount();
+                RecordReadLatency(std::chrono::duration<double>(Clock::now() - start).count());
+                EndRead(tuner, read);
+                if (file.bad()) {
+                    result.error = L"Failed to read file";
+                    return result;
+                }
+            }
+
+            if (progress) {
+                progress(totalRead, result.size);
+            }
+
+            StageTimer timer(timings, &FileHashTimings::hash);
+            totalRead += read;
+            if (blockHasher) {
+                blockHasher->Update(buffer.data, read);
+            } else {
+                result.crc = UpdateChecksumSkipZeros(type, buffer.data, read, result.crc);
+            }
+            if (!identity.empty() && std::chrono::duration<double>(Clock::now() - lastCheckpoint).count() >= CheckpointSeconds) {
+                saveCheckpoint();
+            }
+        }
+    }
+    RemoveCheckpoint(identity, type);
+
+    if (blockHasher) {
+        StageTimer timer(timings, &FileHashTimings::hash);
+        blockHasher->Finish();
+        result.crc = blocks->Checksum();
+    }
+    return result;
+}
+
+std::vector<FileHash> HashFiles(const std::vector<std::filesystem::path>& paths, ChecksumType type, FileHashTimings* timings,
+    std::vector<BlockMap>* blocks) {
+    std::vector<FileHash> results(paths.size());
+    std::vector<size_t> offsets(paths.size(), NotInArena);
+    if (blocks) {
+        blocks->assign(paths.size(), BlockMap{});
+    }
+
+    // small files are read back to back into the arena, their checksums computed together at the end
+    thread_local Arena arena;
+    arena.used = 0;
+    const size_t Chunk = 64;
+    for (size_t begin = 0; begin < paths.size(); begin += Chunk) {
+        size_t end = std::min(begin + Chunk, paths.size());
+#ifdef __linux__
+        if (ReadSmallFilesUring(paths, begin, end, arena, results, offsets, timings)) {
+            continue;
+        }
+#endif
+        ReadSmallFiles(paths, begin, end, arena, results, offsets, timings);
+    }
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (offsets[i] == NotInArena && results[i].error.empty()) {
+            results[i] = HashFile(paths[i], type, nullptr, timings, blocks ? &(*blocks)[i] : nullptr);
+        }
+    }
+
+    StageTimer timer(timings, &FileHashTimings::hash);
+    std::vector<ChecksumJob> jobs;
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (offsets[i] != NotInArena) {
+            jobs.push_back({ arena.At(offsets[i]), (size_t)results[i].size, 0 });
+            indices.push_back(i);
+        }
+    }
+    UpdateChecksums(type, jobs.data(), jobs.size());
+    for (size_t j = 0; j < jobs.size(); j++) {
+        results[indices[j]].crc = jobs[j].checksum;
+        if (blocks) {
+            // small files are a single block
+            BlockMap& map = (*blocks)[indices[j]];
+            map.type = type;
+            map.size = results[indices[j]].size;
+            if (map.size) {
+                map.checksums.push_back(jobs[j].checksum);
+            }
+        }
+    }
+    return results;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "checksum.h"
+
+#include <stdint.h>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BlockMap;
+struct HashControl;
+
+/// accumulated wall time per pipeline stage, in seconds
+struct FileHashTimings {
+    double canonicalize = 0;
+    double open = 0;
+    double read = 0;
+    double hash = 0;
+    double deliver = 0;
+
+    FileHashTimings& operator+=(const FileHashTimings& other) {
+        canonicalize += other.canonicalize;
+        open += other.open;
+        read += other.read;
+        hash += other.hash;
+        deliver += other.deliver;
+        return *this;
+    }
+};
+
+struct FileHash {
+    uint64_t size = 0;
+    uint64_t crc = 0;
+    std::wstring error;
+};
+
+/// called after every block with the number of bytes hashed so far and the file size
+using HashProgressCallback = std::function<void(uint64_t done, uint64_t total)>;
+
+/// canonical form of path, or path itself if it can't be resolved
+std::filesystem::path CanonicalPath(const std::filesystem::path& path, FileHashTimings* timings = nullptr);
+
+/// read the whole file and compute its checksum;
+/// with blocks the checksum of every blocks->blockSize bytes is recorded in it too (see blockmap.h);
+/// huge files without blocks resume from their last checkpoint, control pauses or cancels (see checkpoint.h)
+FileHash HashFile(
+    const std::filesystem::path& path,
+    ChecksumType type = ChecksumType::Crc32,
+    const HashProgressCallback& progress = nullptr,
+    FileHashTimings* timings = nullptr,
+    BlockMap* blocks = nullptr,
+    HashControl* control = nullptr);
+
+/// files up to this size are read whole by HashFiles and hashed side by side
+constexpr uint64_t SmallFileSize = 64 * 1024;
+
+/// HashFile for every path, small files are hashed together in vector lanes (see crcmulti.h);
+/// blocks receives a block map of DefaultBlockSize per path if given
+std::vector<FileHash> HashFiles(
+    const std::vector<std::filesystem::path>& paths,
+    ChecksumType type = ChecksumType::Crc32,
+    FileHashTimings* timings = nullptr,
+    std::vector<BlockMap>* blocks = nullptr);
@@ -0,0 +1,404 @@
+#include "inflate.h"
+
+#include <string.h>
+#include <memory>
+
+namespace {
+
+uint64_t LittleEndian(uint64_t value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(value);
+#else
+    return value;
+#endif
+}
+
+/// LSB first bit buffer over the input, zeros are fed past the end and counted
+struct BitReader {
+    BitReader(const uint8_t* input, size_t length) : next(input), end(input + length) {}
+
+    void Refill() {
+        if (end - next >= 8) {
+            // one unaligned load tops the buffer up to at least 56 bits
+            uint64_t word;
+            memcpy(&word, next, sizeof(word));
+            bits |= LittleEndian(word) << count;
+            next += (63 - count) >> 3;
+            count |= 56;
+            return;
+        }
+        while (count <= 56) {
+            if (next < end) {
+                bits |= (uint64_t)*next++ << count;
+            } else {
+                padding++;
+            }
+            count += 8;
+        }
+    }
+
+    uint32_t Peek(int n) {
+        if (count < n) {
+            Refill();
+        }
+        return (uint32_t)(bits & (((uint64_t)1 << n) - 1));
+    }
+
+    void Drop(int n) {
+        bits >>= n;
+        count -= n;
+    }
+
+    uint32_t Bits(int n) {
+        uint32_t value = Peek(n);
+        Drop(n);
+        return value;
+    }
+
+    /// whether any of the padding zeros were used
+    bool Overrun() const {
+        return padding * 8 > (size_t)count;
+    }
+
+    /// input bytes used so far
+    size_t Consumed(const uint8_t* input) const {
+        return (size_t)(next - input) - (count / 8 - padding);
+    }
+
+    const uint8_t* next;
+    const uint8_t* end;
+    uint64_t bits = 0;
+    int count = 0;
+    size_t padding = 0;
+};
+
+const int MaxBits = 15;
+
+/// canonical Huffman code, codes up to FastBits long are decoded with one table lookup
+struct Huffman {
+    static const int FastBits = 10;
+
+    /// false if the lengths over-subscribe the code, incomplete codes are allowed
+    bool Build(const uint8_t* lengths, int symbols) {
+        memset(count, 0, sizeof(count));
+        for (int i = 0; i < symbols; i++) {
+            count[lengths[i]]++;
+        }
+        count[0] = 0;
+
+        int left = 1;
+        for (int length = 1; length <= MaxBits; length++) {
+            left = (left << 1) - count[length];
+            if (left < 0) {
+                return false;
+            }
+        }
+
+        uint16_t offsets[MaxBits + 2] = {};
+        for (int length = 1; length <= MaxBits; length++) {
+            offsets[length + 1] = offsets[length] + count[length];
+        }
+        for (int i = 0; i < symbols; i++) {
+            if (lengths[i]) {
+                symbol[offsets[lengths[i]]++] = (uint16_t)i;
+            }
+        }
+
+        // codes are read starting with their most significant bit, so the table index is the reversed code
+        memset(fast, 0, sizeof(fast));
+        uint32_t code = 0;
+        int index = 0;
+        for (int length = 1; length <= FastBits; length++) {
+            for (int i = 0; i < count[length]; i++, code++, index++) {
+                uint32_t reversed = 0;
+                for (int bit = 0; bit < length; bit++) {
+                    reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+                }
+                for (uint32_t entry = reversed; entry < (1u << FastBits); entry += 1u << length) {
+                    fast[entry] = (uint16_t)(symbol[index] << 4 | length);
+                }
+            }
+            code <<= 1;
+        }
+        return true;
+    }
+
+    /// next symbol, -1 for a code that isn't assigned
+    int Decode(BitReader& reader) const {
+        uint32_t peek = reader.Peek(MaxBits);
+        uint16_t entry = fast[peek & ((1u << FastBits) - 1)];
+        if (entry) {
+            reader.Drop(entry & 15);
+            return entry >> 4;
+        }
+
+        // one bit at a time, as in zlib's puff
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int length = 1; length <= MaxBits; length++) {
+            code |= (peek >> (length - 1)) & 1;
+            int n = count[length];
+            if (code - n < first) {
+                reader.Drop(length);
+                return symbol[index + (code - first)];
+            }
+            index += n;
+            first = (first + n) << 1;
+            code <<= 1;
+        }
+        return -1;
+    }
+
+    uint16_t fast[1 << FastBits];
+    uint16_t count[MaxBits + 1];
+    uint16_t symbol[288];
+};
+
+const uint16_t LengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t LengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t DistanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t DistanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+const size_t Window = 32 * 1024;
+
+/// decompressed bytes, flushed to the sink once Flush bytes have piled up beyond the window
+struct Output {
+    static const size_t Flush = 1024 * 1024;
+
+    explicit Output(const InflateSink& sink) : sink(sink) {
+        // archive members are mostly small, allocating the buffer for each of them would dominate
+        thread_local std::unique_ptr<uint8_t[]> buffer(new uint8_t[Window + Flush + 258 + 8]);
+        data = buffer.get();
+    }
+
+    /// room for one more match, false if the sink wants no more
+    bool Reserve() {
+        if (size >= Window + Flush) {
+            if (!sink(data, size - Window)) {
+                return false;
+            }
+            memmove(data, data + size - Window, Window);
+            size = Window;
+        }
+        return true;
+    }
+
+    bool Finish() {
+        size_t length = size;
+        size = 0;
+        return sink(data, length);
+    }
+
+    const InflateSink& sink;
+    uint8_t* data;
+    size_t size = 0;
+    /// bytes produced in total, matches can't reach before the start
+    uint64_t total = 0;
+};
+
+bool Codes(BitReader& reader, Output& out, const Huffman& lengths, const Huffman& distances) {
+    while (true) {
+        if (reader.Overrun()) {
+            return false;
+        }
+        if (!out.Reserve()) {
+            return false;
+        }
+        int symbol = lengths.Decode(reader);
+        if (symbol < 0) {
+            return false;
+        }
+        if (symbol < 256) {
+            out.data[out.size++] = (uint8_t)symbol;
+            out.total++;
+            continue;
+        }
+        if (symbol == 256) {
+            return true;
+        }
+
+        symbol -= 257;
+        if (symbol >= 29) {
+            return false;
+        }
+        size_t length = LengthBase[symbol] + reader.Bits(LengthExtra[symbol]);
+        int code = distances.Decode(reader);
+        if (code < 0 || code >= 30) {
+            return false;
+        }
+        size_t distance = DistanceBase[code] + reader.Bits(DistanceExtra[code]);
+        if (distance > out.total) {
+            return false;
+        }
+
+        // 8 bytes at a time unless the source overlaps what is being written,
+        // the buffer has room for the few bytes written past the end
+        uint8_t* to = out.data + out.size;
+        const uint8_t* from = to - distance;
+        if (distance >= 8) {
+            for (size_t i = 0; i < length; i += 8) {
+                memcpy(to + i, from + i, 8);
+            }
+        } else {
+            for (size_t i = 0; i < length; i++) {
+                to[i] = from[i];
+            }
+        }
+        out.size += length;
+        out.total += length;
+    }
+}
+
+bool Stored(BitReader& reader, Output& out) {
+    reader.Drop(reader.count & 7);
+    uint32_t length = reader.Bits(16);
+    uint32_t complement = reader.Bits(16);
+    if (length != (~complement & 0xFFFF)) {
+        return false;
+    }
+    // the first bytes may still sit in the bit buffer
+    while (length && reader.count >= 8) {
+        if (!out.Reserve()) {
+            return false;
+        }
+        out.data[out.size++] = (uint8_t)reader.Bits(8);
+        out.total++;
+        length--;
+    }
+    if (reader.Overrun() || (size_t)(reader.end - reader.next) < length) {
+        return false;
+    }
+    // the buffer may hold bits of the byte at next beyond count, they are stale once next moves
+    reader.bits = 0;
+    while (length) {
+        if (!out.Reserve()) {
+            return false;
+        }
+        size_t n = length < 258 ? length : 258;
+        memcpy(out.data + out.size, reader.next, n);
+        reader.next += n;
+        out.size += n;
+        out.total += n;
+        length -= (uint32_t)n;
+    }
+    return true;
+}
+
+bool Fixed(BitReader& reader, Output& out) {
+    struct FixedCodes {
+        FixedCodes() {
+            uint8_t lengthBits[288];
+            for (int i = 0; i < 288; i++) {
+                lengthBits[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+            }
+            lengths.Build(lengthBits, 288);
+            uint8_t distanceBits[30];
+            memset(distanceBits, 5, sizeof(distanceBits));
+            distances.Build(distanceBits, 30);
+        }
+        Huffman lengths;
+        Huffman distances;
+    };
+    static const FixedCodes codes;
+    return Codes(reader, out, codes.lengths, codes.distances);
+}
+
+bool Dynamic(BitReader& reader, Output& out) {
+    static const uint8_t Order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    int lengthCount = (int)reader.Bits(5) + 257;
+    int distanceCount = (int)reader.Bits(5) + 1;
+    int codeCount = (int)reader.Bits(4) + 4;
+    if (lengthCount > 286 || distanceCount > 30) {
+        return false;
+    }
+
+    uint8_t bits[286 + 30] = {};
+    for (int i = 0; i < codeCount; i++) {
+        bits[Order[i]] = (uint8_t)reader.Bits(3);
+    }
+    Huffman codeLengths;
+    if (!codeLengths.Build(bits, 19)) {
+        return false;
+    }
+
+    memset(bits, 0, sizeof(bits));
+    for (int i = 0; i < lengthCount + distanceCount; ) {
+        int symbol = codeLengths.Decode(reader);
+        if (symbol < 0 || reader.Overrun()) {
+            return false;
+        }
+        if (symbol < 16) {
+            bits[i++] = (uint8_t)symbol;
+            continue;
+        }
+        uint8_t repeated = 0;
+        int times;
+        if (symbol == 16) {
+            if (i == 0) {
+                return false;
+            }
+            repeated = bits[i - 1];
+            times = 3 + (int)reader.Bits(2);
+        } else if (symbol == 17) {
+            times = 3 + (int)reader.Bits(3);
+        } else {
+            times = 11 + (int)reader.Bits(7);
+        }
+        if (i + times > lengthCount + distanceCount) {
+            return false;
+        }
+        while (times--) {
+            bits[i++] = repeated;
+        }
+    }
+    if (bits[256] == 0) {
+        // no end of block code
+        return false;
+    }
+
+    // heap allocated, the tables are a few kilobytes each
+    std::unique_ptr<Huffman[]> codes(new Huffman[2]);
+    if (!codes[0].Build(bits, lengthCount) || !codes[1].Build(bits + lengthCount, distanceCount)) {
+        return false;
+    }
+    return Codes(reader, out, codes[0], codes[1]);
+}
+
+} // anonymous namespace
+
+bool Inflate(const uint8_t* input, size_t length, const InflateSink& sink, size_t* consumed) {
+    BitReader reader(input, length);
+    Output out(sink);
+    bool last;
+    do {
+        last = reader.Bits(1) != 0;
+        bool ok;
+        switch (reader.Bits(2)) {
+        case 0: ok = Stored(reader, out); break;
+        case 1: ok = Fixed(reader, out); break;
+        case 2: ok = Dynamic(reader, out); break;
+        default: ok = false; break;
+        }
+        if (!ok || reader.Overrun()) {
+            return false;
+        }
+    } while (!last);
+
+    if (!out.Finish()) {
+        return false;
+    }
+    if (consumed) {
+        *consumed = reader.Consumed(input);
+    }
+    return true;
+}
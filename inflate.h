@@ -0,0 +1,16 @@
+#pragma once
+
+// Raw DEFLATE decoder (RFC 1951) for checking ZIP members against their stored CRCs and
+// for reading gzip compressed tarballs. Only decompression is needed, so this stays small
+// instead of pulling in zlib.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+/// receives the decompressed data in pieces, in order; returning false stops decompression
+using InflateSink = std::function<bool(const uint8_t* data, size_t length)>;
+
+/// decompress one DEFLATE stream; false if the data is corrupt or ends early, or the sink stopped it;
+/// consumed receives the number of input bytes the stream took
+bool Inflate(const uint8_t* input, size_t length, const InflateSink& sink, size_t* consumed = nullptr);
@@ -0,0 +1,378 @@
+#include "iotuning.h"
+#include "bufferpool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t MinReadSize = 64 * 1024;
+const size_t MaxReadSize = PoolBufferSize;
+/// what reads were before tuning
+const size_t InitialReadSize = 1024 * 1024;
+
+/// an interval lasts at least this long and this many reads per reader before it is judged
+const double IntervalSeconds = 0.25;
+const unsigned IntervalReadsPerReader = 4;
+
+/// a step has to change throughput by more than this to count
+const double Significant = 0.05;
+
+/// after four steps in a row that didn't help, the settings stand for this many intervals before the next try
+const int SettledIntervals = 16;
+
+} // anonymous namespace
+
+struct DeviceTuner {
+    enum class Step {
+        DoubleSize,
+        HalveSize,
+        AddReader,
+        HalveReaders,
+    };
+
+    DeviceTuner(std::string key, size_t readSize, unsigned depth, unsigned maxDepth)
+        : key(std::move(key)), readSize(readSize), depth(depth), maxDepth(maxDepth) {}
+
+    size_t Begin() {
+        std::unique_lock<std::mutex> lock(mtx);
+        changed.wait(lock, [&]() { return inFlight < depth; });
+        if (inFlight == 0 && reads == 0) {
+            intervalStart = Clock::now();
+        }
+        inFlight++;
+        return readSize;
+    }
+
+    size_t ReadSize() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return readSize;
+    }
+
+    /// throws away what was measured of the interval so far
+    void Restart() {
+        std::lock_guard<std::mutex> lock(mtx);
+        bytes = 0;
+        reads = 0;
+        intervalStart = Clock::now();
+    }
+
+    void End(size_t size) {
+        std::lock_guard<std::mutex> lock(mtx);
+        inFlight--;
+        bytes += size;
+        reads++;
+        double elapsed = std::chrono::duration<double>(Clock::now() - intervalStart).count();
+        if (elapsed >= IntervalSeconds && reads >= IntervalReadsPerReader * depth) {
+            Judge(bytes / elapsed);
+            bytes = 0;
+            reads = 0;
+            intervalStart = Clock::now();
+        }
+        changed.notify_all();
+    }
+
+    /// one interval is over: measure, or keep or undo the step that was tried
+    void Judge(double throughput) {
+        lastThroughput = throughput;
+        if (probing) {
+            probing = false;
+            bool faster = throughput > best * (1 + Significant);
+            // fewer readers for the same throughput queue less on the device and leave it to other programs
+            bool leaner = step == Step::HalveReaders && throughput > best * (1 - Significant);
+            if (faster || leaner) {
+                best = throughput;
+                failures = 0;
+                // the same direction once more
+                Try();
+                return;
+            }
+            readSize = previousSize;
+            depth = previousDepth;
+            step = (Step)(((int)step + 1) % 4);
+            if (++failures >= 4) {
+                failures = 0;
+                quiet = SettledIntervals;
+            }
+            // the old settings are measured again before the next try, the load may have changed
+            return;
+        }
+
+        best = throughput;
+        if (quiet > 0) {
+            quiet--;
+            return;
+        }
+        Try();
+    }
+
+    /// apply the next step that is possible, if any
+    void Try() {
+        for (int attempt = 0; attempt < 4; attempt++) {
+            size_t newSize = readSize;
+            unsigned newDepth = depth;
+            switch (step) {
+            case Step::DoubleSize: newSize = std::min(readSize * 2, MaxReadSize); break;
+            case Step::HalveSize: newSize = std::max(readSize / 2, MinReadSize); break;
+            case Step::AddReader: newDepth = std::min(depth + 1, maxDepth); break;
+            case Step::HalveReaders: newDepth = std::max(depth / 2, 1u); break;
+            }
+            if (newSize != readSize || newDepth != depth) {
+                previousSize = readSize;
+                previousDepth = depth;
+                readSize = newSize;
+                depth = newDepth;
+                probing = true;
+                return;
+            }
+            step = (Step)(((int)step + 1) % 4);
+        }
+    }
+
+    std::string key;
+    std::mutex mtx;
+    std::condition_variable changed;
+
+    size_t readSize;
+    unsigned depth;
+    unsigned maxDepth;
+    unsigned inFlight = 0;
+
+    /// the interval being measured
+    Clock::time_point intervalStart = Clock::now();
+    uint64_t bytes = 0;
+    unsigned reads = 0;
+
+    /// hill climbing
+    Step step = Step::DoubleSize;
+    bool probing = false;
+    size_t previousSize = 0;
+    unsigned previousDepth = 0;
+    double best = 0;
+    double lastThroughput = 0;
+    int failures = 0;
+    int quiet = 0;
+};
+
+namespace {
+
+std::atomic<bool> tuningEnabled{ true };
+
+std::filesystem::path SettingsPath() {
+#ifdef _WIN32
+    const wchar_t* appData = _wgetenv(L"APPDATA");
+    return appData ? std::filesystem::path(appData) / L"equals" / L"devices.txt" : std::filesystem::path();
+#else
+    const char* config = getenv("XDG_CONFIG_HOME");
+    if (config && *config) {
+        return std::filesystem::path(config) / "equals" / "devices";
+    }
+    const char* home = getenv("HOME");
+    return home ? std::filesystem::path(home) / ".config" / "equals" / "devices" : std::filesystem::path();
+#endif
+}
+
+/// learned settings, "KEY READ_SIZE DEPTH" per line
+struct Saved {
+    size_t readSize;
+    unsigned depth;
+};
+
+std::map<std::string, Saved> LoadSettings() {
+    std::map<std::string, Saved> settings;
+    std::ifstream file(SettingsPath());
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        Saved saved;
+        if (fields >> key >> saved.readSize >> saved.depth) {
+            settings[key] = saved;
+        }
+    }
+    return settings;
+}
+
+struct Registry {
+    std::mutex mtx;
+    bool loaded = false;
+    std::map<std::string, Saved> saved;
+    /// tuners by device number, several numbers may share a key
+    std::map<uint64_t, DeviceTuner*> byDevice;
+    std::map<std::string, std::unique_ptr<DeviceTuner>> byKey;
+};
+
+/// never destroyed, detached GUI threads may still be reading while the process exits
+Registry& GetRegistry() {
+    static Registry* registry = new Registry;
+    return *registry;
+}
+
+/// number of the device holding path, false if the file can't be looked at
+bool DeviceNumber(const std::filesystem::path& path, uint64_t& number) {
+#ifdef _WIN32
+    wchar_t volume[MAX_PATH + 1];
+    DWORD serial = 0;
+    if (!GetVolumePathNameW(path.c_str(), volume, MAX_PATH + 1) || !GetVolumeInformationW(volume, NULL, 0, &serial, NULL, NULL, NULL, 0)) {
+        return false;
+    }
+    number = serial;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    number = (uint64_t)info.st_dev;
+#endif
+    return true;
+}
+
+/// name of the device that survives a reboot, the settings are saved under it
+std::string DeviceKey(uint64_t number) {
+#ifdef _WIN32
+    char name[32];
+    snprintf(name, sizeof(name), "volume-%08lX", (unsigned long)number);
+    return name;
+#else
+#ifdef __linux__
+    // the kernel's name of a block device; network and virtual file systems get new numbers with every mount
+    std::error_code ec{};
+    dev_t device = (dev_t)number;
+    std::filesystem::path name = std::filesystem::canonical(
+        "/sys/dev/block/" + std::to_string(major(device)) + ":" + std::to_string(minor(device)), ec);
+    if (!ec) {
+        return name.filename().string();
+    }
+#endif
+    return "dev-" + std::to_string((unsigned long long)number);
+#endif
+}
+
+} // anonymous namespace
+
+DeviceTuner* TunerForFile(const std::filesystem::path& path) {
+    if (!tuningEnabled.load()) {
+        return nullptr;
+    }
+    uint64_t number;
+    if (!DeviceNumber(path, number)) {
+        return nullptr;
+    }
+
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mtx);
+    auto found = registry.byDevice.find(number);
+    if (found != registry.byDevice.end()) {
+        return found->second;
+    }
+    std::string key = DeviceKey(number);
+    if (!registry.loaded) {
+        registry.saved = LoadSettings();
+        registry.loaded = true;
+    }
+    std::unique_ptr<DeviceTuner>& tuner = registry.byKey[key];
+    if (!tuner) {
+        unsigned maxDepth = std::max(1u, std::thread::hardware_concurrency());
+        size_t readSize = InitialReadSize;
+        unsigned depth = maxDepth;
+        auto saved = registry.saved.find(key);
+        if (saved != registry.saved.end()) {
+            readSize = std::min(std::max(saved->second.readSize, MinReadSize), MaxReadSize);
+            depth = std::min(std::max(saved->second.depth, 1u), maxDepth);
+        }
+        tuner.reset(new DeviceTuner(key, readSize, depth, maxDepth));
+    }
+    registry.byDevice[number] = tuner.get();
+    return tuner.get();
+}
+
+size_t BeginRead(DeviceTuner* tuner) {
+    return tuner ? tuner->Begin() : InitialReadSize;
+}
+
+size_t NextReadSize(DeviceTuner* tuner) {
+    return tuner ? tuner->ReadSize() : InitialReadSize;
+}
+
+void RestartInterval(DeviceTuner* tuner) {
+    if (tuner) {
+        tuner->Restart();
+    }
+}
+
+void EndRead(DeviceTuner* tuner, size_t bytes) {
+    if (tuner) {
+        tuner->End(bytes);
+    }
+}
+
+void EnableDeviceTuning(bool enabled) {
+    tuningEnabled = enabled;
+}
+
+bool SaveDeviceTuning() {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mtx);
+    if (registry.byKey.empty()) {
+        return true;
+    }
+    std::filesystem::path path = SettingsPath();
+    if (path.empty()) {
+        return false;
+    }
+    // devices not used this time keep what was learned about them before
+    std::map<std::string, Saved> settings = LoadSettings();
+    for (auto& entry : registry.byKey) {
+        DeviceTuner& tuner = *entry.second;
+        std::lock_guard<std::mutex> tunerLock(tuner.mtx);
+        // a step still on trial isn't known to be good
+        settings[entry.first] = tuner.probing ? Saved{ tuner.previousSize, tuner.previousDepth } : Saved{ tuner.readSize, tuner.depth };
+    }
+
+    std::error_code ec{};
+    std::filesystem::create_directories(path.parent_path(), ec);
+    std::ofstream file(path, std::ios::trunc);
+    for (auto& entry : settings) {
+        file << entry.first << ' ' << entry.second.readSize << ' ' << entry.second.depth << '\n';
+    }
+    return (bool)file.flush();
+}
+
+std::vector<std::string> DescribeDeviceTuning() {
+    std::vector<std::string> lines;
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mtx);
+    for (auto& entry : registry.byKey) {
+        DeviceTuner& tuner = *entry.second;
+        std::lock_guard<std::mutex> tunerLock(tuner.mtx);
+        size_t readSize = tuner.probing ? tuner.previousSize : tuner.readSize;
+        unsigned depth = tuner.probing ? tuner.previousDepth : tuner.depth;
+        char line[256];
+        snprintf(line, sizeof(line), "%s: %zu bytes, %u readers, %.1f MB/s",
+            entry.first.c_str(), readSize, depth, tuner.lastThroughput / 1e6);
+        lines.push_back(line);
+    }
+    return lines;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+// Adaptive read size and concurrency per storage device. A fixed read size is too small for
+// striped RAID and network file systems and a fixed number of readers makes a disk head
+// seek between files, so every device gets a controller that watches the throughput of the
+// reads made from it and hill-climbs: it tries doubling or halving the read size, one more
+// reader or half as many, and keeps a step only if the device got faster (or, with half the
+// readers, no slower). What was learned is saved per device for the next scan.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct DeviceTuner;
+
+/// the tuner of the device holding path, shared by every thread reading from that device;
+/// nullptr if tuning is off
+DeviceTuner* TunerForFile(const std::filesystem::path& path);
+
+/// waits until the device takes one more concurrent read, then returns the number of bytes to read
+size_t BeginRead(DeviceTuner* tuner);
+
+/// the number of bytes BeginRead would return now, without waiting for the device
+size_t NextReadSize(DeviceTuner* tuner);
+
+/// start measuring the device anew, after a read was held back by the QoS caps: the throughput
+/// until then was the cap's, and learning from it would carry the cap into the next scan
+void RestartInterval(DeviceTuner* tuner);
+
+/// ends the read started by BeginRead, bytes being how many were read
+void EndRead(DeviceTuner* tuner, size_t bytes);
+
+/// tuning is on unless switched off before the first file is read
+void EnableDeviceTuning(bool enabled);
+
+/// remember the settings of every device used so far for the next scan; false if they can't be written
+bool SaveDeviceTuning();
+
+/// "DEVICE: READ_SIZE bytes, DEPTH readers, MB/s" for each device used so far
+std::vector<std::string> DescribeDeviceTuning();
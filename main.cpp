@@ -1,5 +1,12 @@
 ﻿#include "tcp.h"
-#include "crc32.h"
+#include "checkpoint.h"
+#include "duplicates.h"
+#include "filehash.h"
+#include "iotuning.h"
+#include "manifest.h"
+#include "numa.h"
+#include "options.h"
+#include "resultstore.h"
 
 #include <Windows.h>
 #include <commctrl.h>
@@ -15,17 +22,30 @@
 #include <memory>
 #include <filesystem>
 #include <vector>
-#include <unordered_map>
+#include <iterator>
+#include <algorithm>
+#include <chrono>
+#include <map>
 
 #pragma comment(lib,"Comctl32.lib")
 
 constexpr UINT WM_RESULT = WM_USER + 1;
 constexpr UINT WM_SERVER_MESSAGE = WM_USER + 2;
 
-struct Result {
-    std::wstring path;
-    std::wstring crc;
-    std::wstring size;
+// menu command of a checksum type is ID_CHECKSUM + its index in ChecksumTypes
+constexpr UINT ID_CHECKSUM = 100;
+constexpr UINT ID_PAUSE = 200;
+constexpr UINT ID_RESUME = 201;
+constexpr UINT ID_CANCEL = 202;
+constexpr UINT ID_GROUP = 300;
+
+// posted by the hashing threads, the text is only formatted when the list view draws a row
+struct ResultMessage {
+    uint32_t record = 0;
+    uint32_t generation = 0;
+    uint64_t size = 0;
+    uint64_t crc = 0;
+    uint8_t progress = 0;
     std::wstring error;
 };
 
@@ -54,6 +74,26 @@ struct Program {
             NULL,
             NULL);
 
+        // Create menu
+        checksumMenu = CreatePopupMenu();
+        for (size_t i = 0; i < std::size(ChecksumTypes); i++) {
+            AppendMenuW(checksumMenu, MF_STRING, ID_CHECKSUM + i, ChecksumName(ChecksumTypes[i]));
+        }
+        // pause, resume and cancel act on the selected rows, or on all of them if none is selected
+        HMENU hashingMenu = CreatePopupMenu();
+        AppendMenuW(hashingMenu, MF_STRING, ID_PAUSE, L"&Pause");
+        AppendMenuW(hashingMenu, MF_STRING, ID_RESUME, L"&Resume");
+        AppendMenuW(hashingMenu, MF_STRING, ID_CANCEL, L"&Cancel");
+        // rows of equal size and checksum next to each other instead of sorted by path
+        viewMenu = CreatePopupMenu();
+        AppendMenuW(viewMenu, MF_STRING, ID_GROUP, L"&Group duplicates");
+        HMENU menu = CreateMenu();
+        AppendMenuW(menu, MF_POPUP, (UINT_PTR)checksumMenu, L"&Checksum");
+        AppendMenuW(menu, MF_POPUP, (UINT_PTR)hashingMenu, L"&Hashing");
+        AppendMenuW(menu, MF_POPUP, (UINT_PTR)viewMenu, L"&View");
+        SetMenu(window, menu);
+        CheckChecksumMenuItem();
+
         // Create list view
         INITCOMMONCONTROLSEX icex{};
         icex.dwICC = ICC_LISTVIEW_CLASSES;
@@ -62,7 +102,7 @@ struct Program {
             NULL,
             WC_LISTVIEW,
             L"",
-            WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_EDITLABELS | LVS_SORTASCENDING,
+            WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_EDITLABELS | LVS_OWNERDATA,
             0, 0,
             100, 100,
             window,
@@ -70,14 +110,13 @@ struct Program {
             NULL,
             NULL);
         AddListViewColumn(listView, 0, 400, L"Path", LVCFMT_LEFT);
-        AddListViewColumn(listView, 1, 100, L"CRC32", LVCFMT_RIGHT);
+        AddListViewColumn(listView, 1, 100, (wchar_t*)ChecksumName(checksum), LVCFMT_RIGHT);
         AddListViewColumn(listView, 2, 100, L"Size", LVCFMT_RIGHT);
+        AddListViewColumn(listView, 3, 60, L"Copies", LVCFMT_RIGHT);
 
         ResizeListView();
 
-        for (int i = 1; i < argc; ++i) {
-            ComputeCrc32(argv[i]);
-        }
+        HandleArguments(std::vector<std::wstring>(argv + 1, argv + argc), true);
 
         if (this->server) {
             this->server->Run([this](auto x) { OnMessage(x); });
@@ -92,46 +131,144 @@ struct Program {
         }
     }
 
-    void StoreResult(Result result) {
-        StoreResult(std::make_unique<Result>(std::move(result)));
+    void StoreResult(const ResultMessage& message) {
+        ResultRecord& record = results[message.record];
+        if (record.listed && grouped && message.progress == 100) {
+            // a finished row moves from the path order to its group
+            RemoveRow(message.record);
+        }
+        record.size = message.size;
+        record.crc = message.crc;
+        record.progress = message.progress;
+        if (record.progress == 100) {
+            duplicates.Set(message.record, record.size, record.crc);
+            UpdateTitle();
+            if (manifest.IsOpen()) {
+                manifest.Add(results.Path(message.record), record.crc);
+            }
+        }
+
+        if (!record.listed) {
+            // rows are kept sorted, the list view only knows their number
+            record.listed = true;
+            auto row = std::lower_bound(rows.begin(), rows.end(), message.record,
+                [this](uint32_t a, uint32_t b) { return RowBefore(a, b); });
+            rows.insert(row, message.record);
+            ListView_SetItemCountEx(listView, (int)rows.size(), LVSICF_NOSCROLL);
+        }
+        InvalidateRect(listView, NULL, FALSE);
     }
 
-    void StoreResult(std::unique_ptr<Result> result) {
-        for (size_t i = 0; i < results.size(); i++) {
-            if (results[i].first == result->path) {
-				ListView_SetItemText(listView, i, 1, result->crc.data());
-				ListView_SetItemText(listView, i, 2, result->size.data());
-				results[i].second = std::move(result);
-				return;
-			}
-		}
+    /// by path, or with Group duplicates finished rows first by size (largest first), checksum and path
+    bool RowBefore(uint32_t a, uint32_t b) {
+        if (grouped) {
+            const ResultRecord& recordA = results[a];
+            const ResultRecord& recordB = results[b];
+            bool finishedA = recordA.progress == 100, finishedB = recordB.progress == 100;
+            if (finishedA != finishedB) {
+                return finishedA;
+            }
+            if (finishedA && (recordA.size != recordB.size || recordA.crc != recordB.crc)) {
+                return recordA.size != recordB.size ? recordA.size > recordB.size : recordA.crc < recordB.crc;
+            }
+        }
+        return results.Compare(a, b) < 0;
+    }
 
-        int row = AddListViewItem(
-            listView,
-            result->path.data(),
-            result->crc.data(),
-            result->size.data());
-        results.insert(results.begin() + row, { result->path, std::move(result) });
-	}
+    /// take record's row out of rows, found by the order it was inserted in
+    void RemoveRow(uint32_t record) {
+        auto row = std::lower_bound(rows.begin(), rows.end(), record,
+            [this](uint32_t a, uint32_t b) { return RowBefore(a, b); });
+        if (row != rows.end() && *row == record) {
+            rows.erase(row);
+            results[record].listed = false;
+        }
+    }
+
+    /// the number of groups and wasted bytes in the title bar
+    void UpdateTitle() {
+        std::wstring title = L"Equals";
+        if (duplicates.DuplicateClasses()) {
+            title += L" - " + ToString(duplicates.DuplicateClasses()) + L" groups of duplicates, "
+                + ToString(duplicates.WastedBytes()) + L" bytes wasted";
+        }
+        SetWindowTextW(window, title.c_str());
+    }
+
+    void SetGrouped(bool enabled) {
+        grouped = enabled;
+        std::sort(rows.begin(), rows.end(), [this](uint32_t a, uint32_t b) { return RowBefore(a, b); });
+        CheckMenuItem(viewMenu, ID_GROUP, MF_BYCOMMAND | (grouped ? MF_CHECKED : MF_UNCHECKED));
+        InvalidateRect(listView, NULL, FALSE);
+    }
+
+    void GetDisplayText(LVITEMW& item) {
+        if (!(item.mask & LVIF_TEXT) || item.iItem < 0 || (size_t)item.iItem >= rows.size()) {
+            return;
+        }
+
+        const ResultRecord& record = results[rows[item.iItem]];
+        switch (item.iSubItem) {
+        case 0: displayText = results.Path(rows[item.iItem]); break;
+        case 1:
+            displayText = record.progress < 100 ? Progress(record.progress / 100.0f) : Hex(record.crc, ChecksumDigits(checksum));
+            if (record.paused) {
+                displayText += L" paused";
+            }
+            break;
+        case 2: displayText = ToString(record.size); break;
+        case 3: {
+            // copies of the file, itself included; nothing for files without any
+            uint32_t cls = duplicates.ClassOf(rows[item.iItem]);
+            uint32_t copies = cls == DuplicateIndex::None ? 0 : duplicates.Count(cls);
+            displayText = copies >= 2 ? ToString(copies) : std::wstring();
+            break;
+        }
+        default: displayText.clear(); break;
+        }
+
+        size_t length = std::min(displayText.size(), (size_t)std::max(item.cchTextMax - 1, 0));
+        displayText.copy(item.pszText, length);
+        item.pszText[length] = 0;
+    }
 
     LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
         switch (msg) {
         case WM_RESULT: {
-            std::unique_ptr<Result> result((Result*)wParam);
+            std::unique_ptr<ResultMessage> result((ResultMessage*)wParam);
+            if (result->generation != generation) {
+                // computed before the checksum type changed, the record is gone
+                break;
+            }
 
+            if (!result->error.empty() || result->progress == 100) {
+                controls.erase(result->record);
+            }
+            if (result->error == CancelledError) {
+                // dropping the file again continues from its checkpoint
+                Unlist(result->record);
+                break;
+            }
             if (!result->error.empty()) {
-                std::wstring message = result->path + L"\n" + result->error;
+                std::wstring message = results.Path(result->record) + L"\n" + result->error;
 				MessageBoxW(window, message.c_str(), L"Error", MB_OK | MB_ICONERROR);
 				break;
 			}
 
-            StoreResult(std::move(result));
+            StoreResult(*result);
+            break;
+        }
+        case WM_NOTIFY: {
+            NMHDR* header = (NMHDR*)lParam;
+            if (header->hwndFrom == listView && header->code == LVN_GETDISPINFOW) {
+                GetDisplayText(((NMLVDISPINFOW*)lParam)->item);
+            }
             break;
         }
         case WM_SERVER_MESSAGE: {
-			std::wstring* path = (std::wstring*)wParam;
-			ComputeCrc32(*path);
-			delete path;
+			std::wstring* arg = (std::wstring*)wParam;
+			HandleArguments({ *arg }, false);
+			delete arg;
 			break;
 		}
         case WM_DROPFILES: {
@@ -146,10 +283,24 @@ struct Program {
 			DragFinish(hDrop);
 			break;
         }
+        case WM_COMMAND: {
+            UINT id = LOWORD(wParam);
+            if (id >= ID_CHECKSUM && id < ID_CHECKSUM + std::size(ChecksumTypes)) {
+                SetChecksum(ChecksumTypes[id - ID_CHECKSUM]);
+            } else if (id == ID_PAUSE || id == ID_RESUME || id == ID_CANCEL) {
+                ControlHashing(id);
+            } else if (id == ID_GROUP) {
+                SetGrouped(!grouped);
+            }
+            break;
+        }
         case WM_SIZE:
             ResizeListView();
             break;
         case WM_DESTROY:
+            StopHashing();
+            manifest.Close();
+            SaveDeviceTuning();
             PostQuitMessage(0);
             break;
         default:
@@ -158,6 +309,132 @@ struct Program {
         return 0;
     }
 
+    /// startup is the program's own command line; arguments forwarded by a second instance come
+    /// one at a time, and applying their defaults would undo --background, --tune and the like
+    void HandleArguments(const std::vector<std::wstring>& args, bool startup) {
+        Options options;
+        std::wstring error;
+        if (!ParseOptions(args, options, error)) {
+            std::wstring message = error + L"\n\nOptions:\n" + OptionsHelp();
+            MessageBoxW(window, message.c_str(), L"Error", MB_OK | MB_ICONERROR);
+            return;
+        }
+
+        if (startup) {
+            ApplyOptions(options);
+        }
+        if (options.checksum) {
+            SetChecksum(*options.checksum);
+        }
+        if (!options.manifest.empty()) {
+            // results from now on go to the new manifest
+            manifest.Close();
+            if (!manifest.Open(options.manifest, checksum, error)) {
+                std::wstring message = options.manifest + L"\n" + error;
+                MessageBoxW(window, message.c_str(), L"Error", MB_OK | MB_ICONERROR);
+            }
+        }
+        for (const std::wstring& path : options.paths) {
+            ComputeCrc32(path);
+        }
+    }
+
+    void SetChecksum(ChecksumType type) {
+        if (type == checksum) {
+            return;
+        }
+        checksum = type;
+        generation++;
+        // everything is hashed again with the new checksum: the listed files, and the ones still
+        // waiting for their first progress, which only their control knows of
+        std::vector<std::wstring> paths;
+        for (uint32_t record : rows) {
+            paths.push_back(results.Path(record));
+        }
+        for (auto& entry : controls) {
+            if (!results[entry.first].listed) {
+                paths.push_back(results.Path(entry.first));
+            }
+        }
+        // the running hashes are of the old type, their checkpoints stay for when it is chosen again
+        StopHashing();
+        // a manifest holds checksums of one type, it ends with the old one
+        manifest.Close();
+
+        LVCOLUMNW lvc{};
+        lvc.mask = LVCF_TEXT;
+        lvc.pszText = (wchar_t*)ChecksumName(checksum);
+        ListView_SetColumn(listView, 1, &lvc);
+        CheckChecksumMenuItem();
+        ResizeListView();
+
+        // the old records go in one piece
+        results.Clear();
+        rows.clear();
+        duplicates.Clear();
+        UpdateTitle();
+        ListView_SetItemCountEx(listView, 0, 0);
+        for (const std::wstring& path : paths) {
+            ComputeCrc32(path);
+        }
+    }
+
+    void ControlHashing(UINT id) {
+        std::vector<uint32_t> records;
+        for (int item = -1; (item = ListView_GetNextItem(listView, item, LVNI_SELECTED)) >= 0; ) {
+            records.push_back(rows[item]);
+        }
+        if (records.empty()) {
+            records = rows;
+        }
+
+        for (uint32_t record : records) {
+            auto found = controls.find(record);
+            if (found == controls.end()) {
+                continue;
+            }
+            switch (id) {
+            case ID_PAUSE: found->second->Pause(); break;
+            case ID_RESUME: found->second->Resume(); break;
+            case ID_CANCEL: found->second->Cancel(); break;
+            }
+            results[record].paused = id == ID_PAUSE;
+        }
+        InvalidateRect(listView, NULL, FALSE);
+    }
+
+    /// cancel every running hash and give the threads a moment to save their checkpoints
+    void StopHashing() {
+        for (auto& entry : controls) {
+            entry.second->Cancel();
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        for (auto& entry : controls) {
+            double left = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+            entry.second->WaitFinished(std::max(left, 0.0));
+        }
+        controls.clear();
+    }
+
+    /// take a record out of the list view, as if it had never been dropped
+    void Unlist(uint32_t record) {
+        RemoveRow(record);
+        ListView_SetItemCountEx(listView, (int)rows.size(), LVSICF_NOSCROLL);
+        results[record] = ResultRecord{ 0, 0, results[record].path };
+        duplicates.Reset(record);
+        UpdateTitle();
+        InvalidateRect(listView, NULL, FALSE);
+    }
+
+    void CheckChecksumMenuItem() {
+        for (size_t i = 0; i < std::size(ChecksumTypes); i++) {
+            if (ChecksumTypes[i] == checksum) {
+                UINT last = ID_CHECKSUM + (UINT)std::size(ChecksumTypes) - 1;
+                CheckMenuRadioItem(checksumMenu, ID_CHECKSUM, last, ID_CHECKSUM + (UINT)i, MF_BYCOMMAND);
+            }
+        }
+    }
+
     void OnMessage(std::vector<uint8_t> message) {
         std::wstring* path = new std::wstring((wchar_t*)message.data(), message.size() / sizeof(wchar_t));
         PostMessageW(window, WM_SERVER_MESSAGE, (WPARAM)path, 0);
@@ -171,9 +448,12 @@ struct Program {
 
         SetWindowPos(listView, NULL, 0, 0, width, height, SWP_NOZORDER);
 
-        ListView_SetColumnWidth(listView, 0, width - 200);
-        ListView_SetColumnWidth(listView, 1, 100);
+        // 16 hex digits need a wider column
+        int checksumWidth = ChecksumDigits(checksum) > 8 ? 160 : 100;
+        ListView_SetColumnWidth(listView, 0, width - checksumWidth - 160);
+        ListView_SetColumnWidth(listView, 1, checksumWidth);
         ListView_SetColumnWidth(listView, 2, 100);
+        ListView_SetColumnWidth(listView, 3, 60);
     }
 
     void AddListViewColumn(HWND hwnd, int col, int width, wchar_t* text, int fmt) {
@@ -186,76 +466,56 @@ struct Program {
         ListView_InsertColumn(hwnd, col, &lvc);
     }
 
-    int AddListViewItem(HWND hwnd, wchar_t* path, wchar_t* crc, wchar_t* size) {
-        LVITEMW item{};
-        item.mask = LVIF_TEXT;
-        item.iItem = 0;
-        item.pszText = path;
-        item.iSubItem = 0;
-        int row = ListView_InsertItem(hwnd, &item);
-
-        ListView_SetItemText(hwnd, row, 1, crc);
-        ListView_SetItemText(hwnd, row, 2, size);
-        return row;
-    }
-
-    void PostResult(Result result) {
-        PostMessageW(window, WM_RESULT, (WPARAM)new Result(result), NULL);
+    void PostResult(const ResultMessage& message) {
+        PostMessageW(window, WM_RESULT, (WPARAM)new ResultMessage(message), NULL);
     }
 
     void ComputeCrc32(const std::wstring& path) {
-        Result result{};
-        result.path = path;
-
-        std::error_code ec{};
-        std::wstring canonPath = std::filesystem::canonical(path, ec).wstring();
-        if (!ec) {
-            result.path = std::move(canonPath);
-        }
-        NormalizePath(result.path);
+        std::wstring canonical = CanonicalPath(path).wstring();
+        NormalizePath(canonical);
 
-        if (std::find_if(results.begin(), results.end(), [&result](auto&& x) { return x.first == result.path; }) != results.end()) {
+        uint32_t record = results.Add(canonical);
+        // listed once its first progress arrives, before that only its control tells it is being hashed
+        if (results[record].listed || controls.count(record)) {
             return;
         }
 
-        std::thread([this, result = std::move(result)]() mutable {
-            std::ifstream file(result.path, std::ios::binary | std::ios::ate);
-            if (!file) {
-                result.error = L"Failed to open file";
-                PostResult(std::move(result));
-                return;
+        std::shared_ptr<HashControl> control = std::make_shared<HashControl>();
+        controls[record] = control;
+        std::thread([this, type = checksum, path = std::move(canonical), record, generation = generation, control]() {
+            // on the node of the file's disk controller if known, otherwise files take turns among the nodes;
+            // the read buffer is allocated after this, on the same node
+            int nodes = NumaNodeCount();
+            if (nodes > 1) {
+                int node = NumaNodeOfFile(path);
+                BindThreadToNumaNode(node >= 0 ? node : (int)(record % nodes));
             }
 
-            uint64_t size = (uint64_t)file.tellg();
-            result.size = ToString(size);
-            file.seekg(0, std::ios::beg);
-
-            std::vector<uint8_t> buffer(1024 * 1024);
-            uint32_t crc = 0;
-            uint64_t totalRead = 0;
+            ResultMessage result;
+            result.record = record;
+            result.generation = generation;
             float progress = 0;
-            while (file) {
-                file.read((char*)buffer.data(), buffer.size());
-                if (file.bad()) {
-                    result.error = L"Failed to read file";
-                    PostResult(std::move(result));
-                    return;
-                }
-                size_t read = (size_t)file.gcount();
-                
+            FileHash hash = HashFile(path, type, [&](uint64_t totalRead, uint64_t size) {
                 float newProgress = (float)totalRead / size;
                 if (newProgress - progress > 0.01f) {
-					progress = newProgress;
-                    result.crc = Progress((float)totalRead / size);
+                    progress = newProgress;
+                    result.size = size;
+                    result.progress = (uint8_t)std::min(newProgress * 100, 99.0f);
                     PostResult(result);
-				}
+                }
+            }, nullptr, nullptr, control.get());
+            control->Finish();
 
-                totalRead += read;
-                crc = crc32_fast(buffer.data(), read, crc);
+            if (!hash.error.empty()) {
+                result.error = std::move(hash.error);
+                PostResult(result);
+                return;
             }
 
-            result.crc = Hex(crc);
-            PostResult(std::move(result));
+            result.size = hash.size;
+            result.crc = hash.crc;
+            result.progress = 100;
+            PostResult(result);
         }).detach();
     }
 
@@ -267,9 +527,9 @@ struct Program {
         return ToString((uint64_t)(value * 100)) + L'%';
 	}
 
-    static std::wstring Hex(uint32_t value) {
+    static std::wstring Hex(uint64_t value, int digits) {
         std::wstring result;
-        for (int i = 0; i < sizeof(uint32_t) * 2; ++i) {
+        for (int i = 0; i < digits; ++i) {
             int digit = (value >> (i * 4)) & 0xF;
             result = L"0123456789ABCDEF"[digit] + result;
         }
@@ -294,8 +554,23 @@ struct Program {
     static Program* instance;
     HWND window;
     HWND listView;
+    HMENU checksumMenu;
+    HMENU viewMenu;
     std::unique_ptr<TcpServer> server;
-    std::vector<std::pair<std::wstring, std::unique_ptr<Result>>> results;
+    ChecksumType checksum = ChecksumType::Crc32;
+    uint32_t generation = 0;
+    ResultStore results;
+    /// records in the list view, in the order of RowBefore
+    std::vector<uint32_t> rows;
+    bool grouped = false;
+    /// classes of equal size and checksum among the finished records
+    DuplicateIndex duplicates;
+    /// --manifest, every finished record is appended
+    ManifestWriter manifest;
+    /// records still being hashed
+    std::map<uint32_t, std::shared_ptr<HashControl>> controls;
+    /// text handed to the list view by GetDisplayText
+    std::wstring displayText;
 };
 
 Program* Program::instance = nullptr;
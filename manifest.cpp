@@ -0,0 +1,164 @@
+#include "manifest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <wctype.h>
+#include <algorithm>
+
+namespace {
+
+/// written through at least this often, so a crash loses no more than this much of the manifest
+const double FlushSeconds = 1;
+
+/// value of the hex digits, false if there is anything else or too many of them
+bool ParseHex(std::string_view digits, uint64_t& value) {
+    if (digits.empty() || digits.size() > 16) {
+        return false;
+    }
+    value = 0;
+    for (char c : digits) {
+        int digit = c >= '0' && c <= '9' ? c - '0'
+            : c >= 'A' && c <= 'F' ? c - 'A' + 10
+            : c >= 'a' && c <= 'f' ? c - 'a' + 10
+            : -1;
+        if (digit < 0) {
+            return false;
+        }
+        value = value << 4 | (uint64_t)digit;
+    }
+    return true;
+}
+
+/// the manifest's directory, which relative paths in it are relative to
+std::filesystem::path ManifestDirectory(const std::filesystem::path& path) {
+    std::error_code ec{};
+    std::filesystem::path absolute = std::filesystem::weakly_canonical(std::filesystem::absolute(path, ec), ec);
+    return (ec ? path : absolute).parent_path();
+}
+
+} // anonymous namespace
+
+ManifestFormat ManifestFormatOf(const std::filesystem::path& path) {
+    std::wstring extension = path.extension().wstring();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](wchar_t c) { return (wchar_t)towlower(c); });
+    return extension == L".sfv" ? ManifestFormat::Sfv : ManifestFormat::Plain;
+}
+
+bool ManifestWriter::Open(const std::filesystem::path& path, ChecksumType type, std::wstring& error) {
+    format = ManifestFormatOf(path);
+    if (format == ManifestFormat::Sfv && type != ChecksumType::Crc32) {
+        error = L"SFV files hold CRC32 checksums only";
+        return false;
+    }
+    this->type = type;
+    directory = ManifestDirectory(path);
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error = L"Failed to create manifest";
+        return false;
+    }
+    if (format == ManifestFormat::Sfv) {
+        out << "; Generated by equals\n";
+    }
+    flushed = std::chrono::steady_clock::now();
+    return true;
+}
+
+void ManifestWriter::Add(const std::filesystem::path& file, uint64_t checksum) {
+    // relative below the manifest's directory, so the tree can be moved along with it
+    std::filesystem::path relative = file.lexically_relative(directory);
+    std::string name = !relative.empty() && *relative.begin() != ".." ? relative.generic_u8string() : file.generic_u8string();
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%0*llX", ChecksumDigits(type), (unsigned long long)checksum);
+    if (format == ManifestFormat::Sfv) {
+        out << name << ' ' << hex << '\n';
+    } else {
+        out << hex << ' ' << name << '\n';
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - flushed).count() >= FlushSeconds) {
+        out.flush();
+        flushed = now;
+    }
+}
+
+bool ManifestWriter::Close() {
+    if (!out.is_open()) {
+        return true;
+    }
+    out.close();
+    return !out.fail();
+}
+
+bool Manifest::Load(const std::filesystem::path& path, std::optional<ChecksumType> type, std::wstring& error) {
+    entries.clear();
+    if (!file.Open(path)) {
+        error = L"Failed to open manifest";
+        return false;
+    }
+    directory = ManifestDirectory(path);
+    ManifestFormat format = ManifestFormatOf(path);
+    this->type = format == ManifestFormat::Sfv ? ChecksumType::Crc32 : type.value_or(ChecksumType::Crc32);
+    if (file.size == 0) {
+        return true;
+    }
+    if (file.size > SIZE_MAX || !file.Map(0, (size_t)file.size, view, true)) {
+        error = L"Failed to map manifest";
+        return false;
+    }
+
+    // about 60 bytes per line, reserved up front so that millions of entries aren't copied while growing
+    entries.reserve(view.size / 60);
+    const char* data = (const char*)view.data;
+    int digits = 0;
+    size_t lineNumber = 0;
+    for (size_t begin = 0; begin < view.size; ) {
+        const char* newline = (const char*)memchr(data + begin, '\n', view.size - begin);
+        size_t end = newline ? (size_t)(newline - data) : view.size;
+        size_t next = end + 1;
+        lineNumber++;
+        if (end > begin && data[end - 1] == '\r') {
+            end--;
+        }
+        std::string_view line(data + begin, end - begin);
+        size_t lineStart = begin;
+        begin = next;
+        if (line.empty() || (format == ManifestFormat::Sfv && line[0] == ';')) {
+            continue;
+        }
+
+        // SFV puts the checksum after the last space, plain manifests before the first one
+        ManifestEntry entry{};
+        size_t space = format == ManifestFormat::Sfv ? line.rfind(' ') : line.find(' ');
+        std::string_view hex, name;
+        if (space != std::string_view::npos) {
+            hex = format == ManifestFormat::Sfv ? line.substr(space + 1) : line.substr(0, space);
+            name = format == ManifestFormat::Sfv ? line.substr(0, space) : line.substr(space + 1);
+        }
+        // every line has as many digits as the first one
+        bool valid = ParseHex(hex, entry.checksum) && !name.empty() && (hex.size() == 8 || hex.size() == 16)
+            && (digits == 0 || (int)hex.size() == digits) && (format == ManifestFormat::Plain || hex.size() == 8);
+        if (!valid) {
+            error = L"Malformed line " + std::to_wstring(lineNumber) + L" in manifest";
+            entries.clear();
+            return false;
+        }
+        digits = (int)hex.size();
+        entry.offset = lineStart + (size_t)(name.data() - line.data());
+        entry.length = (uint32_t)name.size();
+        entries.push_back(entry);
+    }
+    if (digits == 16) {
+        this->type = ChecksumType::Crc64;
+    } else if (this->type == ChecksumType::Crc64) {
+        this->type = ChecksumType::Crc32;
+    }
+    return true;
+}
+
+std::filesystem::path Manifest::Path(const ManifestEntry& entry) const {
+    std::filesystem::path path = std::filesystem::u8path(Name(entry));
+    return path.is_relative() ? directory / path : path;
+}
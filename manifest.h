@@ -0,0 +1,81 @@
+#pragma once
+
+// Checksum manifests: one line per file, so results outlive the program and a copy or an
+// archive can be checked against them later. Files ending in .sfv are written and read as
+// SFV ("PATH CRC32", ';' starts a comment), everything else as "CHECKSUM PATH", the form
+// equals-cli prints without the size. Lines are appended as results come in; a manifest is
+// read by mapping it and parsing it in place, entries point into the mapping instead of
+// holding a copy of their path, so manifests of millions of files load in a blink.
+
+#include "checksum.h"
+#include "mappedfile.h"
+
+#include <stdint.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class ManifestFormat {
+    Sfv,
+    Plain,
+};
+
+/// SFV for paths ending in .sfv, case insensitive
+ManifestFormat ManifestFormatOf(const std::filesystem::path& path);
+
+/// appends a line per file; not synchronized, the caller serializes Add
+struct ManifestWriter {
+    /// create or replace path, false with error set if it can't be written or an SFV file is asked for another type than CRC32
+    bool Open(const std::filesystem::path& path, ChecksumType type, std::wstring& error);
+
+    /// the line of one file, paths below the manifest's directory are written relative to it;
+    /// written through to the file at least every second
+    void Add(const std::filesystem::path& file, uint64_t checksum);
+
+    /// false if anything failed to be written
+    bool Close();
+
+    bool IsOpen() const {
+        return out.is_open();
+    }
+
+private:
+    std::ofstream out;
+    std::filesystem::path directory;
+    ManifestFormat format = ManifestFormat::Plain;
+    ChecksumType type = ChecksumType::Crc32;
+    std::chrono::steady_clock::time_point flushed;
+};
+
+struct ManifestEntry {
+    uint64_t checksum;
+    /// the path as written, in UTF-8, at offset in the mapping
+    size_t offset;
+    uint32_t length;
+};
+
+struct Manifest {
+    /// map and parse path; type is used for plain manifests with 8 digit checksums, which
+    /// don't tell CRC32 from CRC32C (16 digits are CRC64, SFV is CRC32);
+    /// false with error set if path can't be read or a line is malformed
+    bool Load(const std::filesystem::path& path, std::optional<ChecksumType> type, std::wstring& error);
+
+    /// the path of entry, relative ones resolved against the manifest's directory
+    std::filesystem::path Path(const ManifestEntry& entry) const;
+
+    std::string_view Name(const ManifestEntry& entry) const {
+        return std::string_view((const char*)view.data + entry.offset, entry.length);
+    }
+
+    ChecksumType type = ChecksumType::Crc32;
+    std::vector<ManifestEntry> entries;
+
+private:
+    MappedFile file;
+    MappedFile::View view;
+    std::filesystem::path directory;
+};
@@ -0,0 +1,107 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::View::~View() {
+    if (base) {
+        UnmapViewOfFile(base);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+}
+
+bool MappedFile::Open(const std::filesystem::path& path) {
+    file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER fileSize;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)) {
+        return false;
+    }
+    size = (uint64_t)fileSize.QuadPart;
+    mapping = size ? CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    return size == 0 || mapping != NULL;
+}
+
+bool MappedFile::Map(uint64_t offset, size_t length, View& view, bool sequential) const {
+    (void)sequential;
+    if (length == 0 || offset > size || length > size - offset) {
+        return false;
+    }
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    uint64_t start = offset - offset % info.dwAllocationGranularity;
+    size_t mapped = (size_t)(offset - start) + length;
+    void* base = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(start >> 32), (DWORD)start, mapped);
+    if (!base) {
+        return false;
+    }
+    view.base = base;
+    view.mapped = mapped;
+    view.data = (const uint8_t*)base + (offset - start);
+    view.size = length;
+    return true;
+}
+
+#else
+
+MappedFile::View::~View() {
+    if (base) {
+        munmap(base, mapped);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool MappedFile::Open(const std::filesystem::path& path) {
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        return false;
+    }
+    size = (uint64_t)info.st_size;
+    return true;
+}
+
+bool MappedFile::Map(uint64_t offset, size_t length, View& view, bool sequential) const {
+    if (length == 0 || offset > size || length > size - offset) {
+        return false;
+    }
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t start = offset - offset % page;
+    size_t mapped = (size_t)(offset - start) + length;
+    void* base = mmap(nullptr, mapped, PROT_READ, MAP_PRIVATE, fd, (off_t)start);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    if (sequential) {
+        madvise(base, mapped, MADV_SEQUENTIAL);
+    }
+    view.base = base;
+    view.mapped = mapped;
+    view.data = (const uint8_t*)base + (offset - start);
+    view.size = length;
+    return true;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+// Read-only memory mapping of parts of a file, for formats that keep their index at the end
+// (ZIP) or are decompressed straight from the page cache (gzip).
+
+#include <stdint.h>
+#include <stddef.h>
+#include <filesystem>
+
+struct MappedFile {
+    /// a mapped byte range, unmapped when it goes out of scope
+    struct View {
+        View() = default;
+        View(const View&) = delete;
+        View& operator=(const View&) = delete;
+        ~View();
+
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+
+    private:
+        friend struct MappedFile;
+        void* base = nullptr;
+        size_t mapped = 0;
+    };
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    /// false if path can't be opened or isn't a regular file
+    bool Open(const std::filesystem::path& path);
+
+    /// map length bytes at offset, false if the range is empty, outside the file or can't be mapped;
+    /// sequential tells the system the range will be read once from front to back
+    bool Map(uint64_t offset, size_t length, View& view, bool sequential = false) const;
+
+    uint64_t size = 0;
+
+private:
+#ifdef _WIN32
+    void* file = (void*)(intptr_t)-1;
+    void* mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
@@ -0,0 +1,198 @@
+#include "numa.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+namespace {
+
+struct NumaNode {
+    /// number the system knows the node by
+    int id;
+#ifdef _WIN32
+    GROUP_AFFINITY affinity;
+#else
+    std::vector<int> cpus;
+#endif
+};
+
+#ifdef __linux__
+/// "0-3,8,10-11" as in sysfs cpulist files
+std::vector<int> ParseCpuList(const std::string& text) {
+    std::vector<int> cpus;
+    size_t position = 0;
+    while (position < text.size()) {
+        size_t end = text.find(',', position);
+        std::string range = text.substr(position, end == std::string::npos ? std::string::npos : end - position);
+        size_t dash = range.find('-');
+        try {
+            int first = std::stoi(range);
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        } catch (...) {
+            // trailing newline or damaged entry
+        }
+        if (end == std::string::npos) {
+            break;
+        }
+        position = end + 1;
+    }
+    return cpus;
+}
+#endif
+
+/// the nodes that have processors, in order of their ids; empty where the topology is unknown
+std::vector<NumaNode> DetectNodes() {
+    std::vector<NumaNode> nodes;
+#if defined(__linux__)
+    std::error_code ec{};
+    for (auto it = std::filesystem::directory_iterator("/sys/devices/system/node", ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name.compare(0, 4, "node") != 0 || name.size() == 4 || name.find_first_not_of("0123456789", 4) != std::string::npos) {
+            continue;
+        }
+        std::string list;
+        std::getline(std::ifstream(it->path() / "cpulist"), list);
+        NumaNode node;
+        node.id = std::stoi(name.substr(4));
+        node.cpus = ParseCpuList(list);
+        if (!node.cpus.empty()) {
+            nodes.push_back(std::move(node));
+        }
+    }
+#elif defined(_WIN32)
+    ULONG highest = 0;
+    if (GetNumaHighestNodeNumber(&highest)) {
+        for (USHORT id = 0; id <= highest; id++) {
+            NumaNode node{};
+            node.id = id;
+            if (GetNumaNodeProcessorMaskEx(id, &node.affinity) && node.affinity.Mask) {
+                nodes.push_back(node);
+            }
+        }
+    }
+#endif
+    std::sort(nodes.begin(), nodes.end(), [](const NumaNode& a, const NumaNode& b) { return a.id < b.id; });
+    return nodes;
+}
+
+thread_local int boundNode = 0;
+
+const std::vector<NumaNode>& Nodes() {
+    static const std::vector<NumaNode> nodes = DetectNodes();
+    return nodes;
+}
+
+#ifdef __linux__
+/// node of a block device from sysfs: the first ancestor of the device (usually its PCI
+/// controller) that reports one; -1 for devices without one, such as network file systems
+int DeviceNumaNode(dev_t device) {
+    std::error_code ec{};
+    std::string link = "/sys/dev/block/" + std::to_string(major(device)) + ":" + std::to_string(minor(device));
+    std::filesystem::path path = std::filesystem::canonical(link, ec);
+    if (ec) {
+        return -1;
+    }
+    for (; path.has_relative_path() && path != "/sys/devices"; path = path.parent_path()) {
+        std::ifstream file(path / "numa_node");
+        int id;
+        if (file >> id && id >= 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+#endif
+
+} // anonymous namespace
+
+int NumaNodeCount() {
+    return std::max<int>(1, (int)Nodes().size());
+}
+
+bool BindThreadToNumaNode(int node) {
+    const std::vector<NumaNode>& nodes = Nodes();
+    if (node < 0 || (size_t)node >= nodes.size()) {
+        return false;
+    }
+#if defined(__linux__)
+    int highest = *std::max_element(nodes[node].cpus.begin(), nodes[node].cpus.end());
+    cpu_set_t* set = CPU_ALLOC(highest + 1);
+    if (!set) {
+        return false;
+    }
+    size_t size = CPU_ALLOC_SIZE(highest + 1);
+    CPU_ZERO_S(size, set);
+    for (int cpu : nodes[node].cpus) {
+        CPU_SET_S(cpu, size, set);
+    }
+    bool bound = sched_setaffinity(0, size, set) == 0;
+    CPU_FREE(set);
+    if (bound) {
+        boundNode = node;
+    }
+    return bound;
+#elif defined(_WIN32)
+    if (!SetThreadGroupAffinity(GetCurrentThread(), &nodes[node].affinity, NULL)) {
+        return false;
+    }
+    boundNode = node;
+    return true;
+#else
+    return false;
+#endif
+}
+
+int CurrentNumaNode() {
+    return boundNode;
+}
+
+int NumaNodeOfFile(const std::filesystem::path& path) {
+    if (Nodes().size() < 2) {
+        return -1;
+    }
+#ifdef __linux__
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return -1;
+    }
+    // one sysfs walk per device, a scan usually touches only a few
+    static std::mutex mtx;
+    static std::map<dev_t, int> devices;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto found = devices.find(info.st_dev);
+    if (found != devices.end()) {
+        return found->second;
+    }
+    int id = DeviceNumaNode(info.st_dev);
+    int node = -1;
+    for (size_t i = 0; i < Nodes().size(); i++) {
+        if (Nodes()[i].id == id) {
+            node = (int)i;
+        }
+    }
+    devices[info.st_dev] = node;
+    return node;
+#else
+    // Windows doesn't tell which node a disk controller is attached to
+    (void)path;
+    return -1;
+#endif
+}
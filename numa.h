@@ -0,0 +1,23 @@
+#pragma once
+
+// NUMA placement for the hashing threads. On machines with several memory nodes a thread
+// that reads into a buffer on another node pays for every byte twice over the interconnect.
+// Binding a worker to the processors of one node before it touches its buffers keeps them
+// on that node (first-touch allocation), and the file's storage controller decides which
+// node should read it, when the system says.
+
+#include <stddef.h>
+#include <filesystem>
+
+/// number of NUMA nodes with processors, 1 where the topology is unknown
+int NumaNodeCount();
+
+/// restrict the calling thread to the processors of node (0 to NumaNodeCount() - 1);
+/// false if that isn't possible, the thread may then run anywhere as before
+bool BindThreadToNumaNode(int node);
+
+/// node the calling thread was bound to, 0 if it wasn't
+int CurrentNumaNode();
+
+/// node closest to the device holding path, -1 if unknown or if there is only one node
+int NumaNodeOfFile(const std::filesystem::path& path);
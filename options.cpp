@@ -0,0 +1,234 @@
+#include "options.h"
+#include "bufferpool.h"
+#include "checkpoint.h"
+#include "iotuning.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace {
+
+bool StartsWith(const std::wstring& text, const wchar_t* prefix, std::wstring& rest) {
+    size_t length = std::char_traits<wchar_t>::length(prefix);
+    if (text.compare(0, length, prefix) != 0) {
+        return false;
+    }
+    rest = text.substr(length);
+    return true;
+}
+
+std::string Narrow(const std::wstring& text) {
+    std::string result;
+    for (wchar_t c : text) {
+        result.push_back(c < 0x80 ? (char)c : '?');
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+bool ParseOptions(const std::vector<std::wstring>& args, Options& options, std::wstring& error) {
+    for (const std::wstring& arg : args) {
+        std::wstring value;
+        if (arg.compare(0, 2, L"--") != 0) {
+            options.paths.push_back(arg);
+        } else if (StartsWith(arg, L"--checksum=", value)) {
+            ChecksumType type;
+            if (!ParseChecksumType(value, type)) {
+                error = L"Unknown checksum: " + value;
+                return false;
+            }
+            options.checksum = type;
+        } else if (StartsWith(arg, L"--kernel=", value)) {
+            Crc32Kernel kernel;
+            if (value == L"auto") {
+                options.calibrate = true;
+                options.kernel.reset();
+            } else if (ParseCrc32Kernel(Narrow(value).c_str(), kernel)) {
+                options.calibrate = false;
+                options.kernel = kernel;
+            } else {
+                error = L"Unknown CRC32 kernel: " + value;
+                return false;
+            }
+        } else if (StartsWith(arg, L"--archives=", value)) {
+            if (value != L"stored" && value != L"verify") {
+                error = L"Unknown archive mode: " + value;
+                return false;
+            }
+            options.archives = true;
+            options.verifyArchives = value == L"verify";
+        } else if (arg == L"--overlap") {
+            options.overlap = true;
+        } else if (StartsWith(arg, L"--blockmaps=", value)) {
+            if (value.empty()) {
+                error = L"--blockmaps needs a directory";
+                return false;
+            }
+            options.blockMaps = value;
+        } else if (arg == L"--diff") {
+            options.diff = true;
+        } else if (StartsWith(arg, L"--copy=", value)) {
+            if (value.empty()) {
+                error = L"--copy needs a directory";
+                return false;
+            }
+            options.copyTo = value;
+        } else if (StartsWith(arg, L"--manifest=", value)) {
+            if (value.empty()) {
+                error = L"--manifest needs a file";
+                return false;
+            }
+            options.manifest = value;
+        } else if (StartsWith(arg, L"--verify=", value)) {
+            if (value.empty()) {
+                error = L"--verify needs a manifest";
+                return false;
+            }
+            options.verify = value;
+        } else if (arg == L"--duplicates") {
+            options.duplicates = true;
+        } else if (StartsWith(arg, L"--buffer-memory=", value)) {
+            wchar_t* end;
+            unsigned long long megabytes = wcstoull(value.c_str(), &end, 10);
+            if (value.empty() || *end || megabytes > MaxBufferPoolMemory / (1024 * 1024) || megabytes * 1024 * 1024 < PoolBufferSize) {
+                error = L"Invalid buffer memory: " + value;
+                return false;
+            }
+            options.bufferMemory = megabytes * 1024 * 1024;
+        } else if (arg == L"--huge-pages") {
+            options.hugePages = true;
+        } else if (StartsWith(arg, L"--tune=", value)) {
+            if (value != L"on" && value != L"off" && value != L"verbose") {
+                error = L"Unknown tuning mode: " + value;
+                return false;
+            }
+            options.tune = value != L"off";
+            options.verboseTuning = value == L"verbose";
+        } else if (StartsWith(arg, L"--checkpoints=", value)) {
+            if (value != L"on" && value != L"off") {
+                error = L"Unknown checkpoint mode: " + value;
+                return false;
+            }
+            options.checkpoints = value == L"on";
+        } else if (arg == L"--background") {
+            options.qos.background = true;
+        } else if (StartsWith(arg, L"--max-read-rate=", value)) {
+            wchar_t* end;
+            unsigned long long megabytes = wcstoull(value.c_str(), &end, 10);
+            if (value.empty() || *end || megabytes == 0 || megabytes > UINT64_MAX / (1000 * 1000)) {
+                error = L"Invalid read rate: " + value;
+                return false;
+            }
+            options.qos.maxBytesPerSecond = megabytes * 1000 * 1000;
+        } else if (StartsWith(arg, L"--max-read-ops=", value)) {
+            wchar_t* end;
+            errno = 0;
+            // not wcstoul: unsigned long is 32 bits on Windows, an overflow would clamp to a valid value
+            unsigned long long reads = wcstoull(value.c_str(), &end, 10);
+            if (value.empty() || *end || errno == ERANGE || reads == 0 || reads > UINT32_MAX) {
+                error = L"Invalid read operation rate: " + value;
+                return false;
+            }
+            options.qos.maxReadsPerSecond = (uint32_t)reads;
+        } else if (StartsWith(arg, L"--order=", value)) {
+            if (value == L"auto") {
+                options.order = ReadOrder::Auto;
+            } else if (value == L"disk") {
+                options.order = ReadOrder::Disk;
+            } else if (value == L"listed") {
+                options.order = ReadOrder::Listed;
+            } else {
+                error = L"Unknown read order: " + value;
+                return false;
+            }
+        } else {
+            error = L"Unknown option: " + arg;
+            return false;
+        }
+    }
+    if (options.archives && !options.verifyArchives && options.checksum.value_or(ChecksumType::Crc32) != ChecksumType::Crc32) {
+        error = L"Archives only store CRC32, use --archives=verify for other checksums";
+        return false;
+    }
+    if (options.archives && options.overlap) {
+        error = L"--overlap compares whole files, it can't be combined with --archives";
+        return false;
+    }
+    if (options.diff && (options.archives || options.overlap || !options.blockMaps.empty())) {
+        error = L"--diff can't be combined with --archives, --overlap or --blockmaps";
+        return false;
+    }
+    if (options.diff && options.paths.size() != 2) {
+        error = L"--diff compares two block maps or files";
+        return false;
+    }
+    return true;
+}
+
+void ApplyOptions(const Options& options) {
+    if (options.bufferMemory || options.hugePages) {
+        ConfigureBufferPool(options.bufferMemory.value_or(DefaultBufferPoolMemory), options.hugePages);
+    }
+    EnableDeviceTuning(options.tune);
+    EnableCheckpoints(options.checkpoints);
+    ConfigureQos(options.qos);
+    if (options.calibrate) {
+        CalibrateCrc32();
+    } else if (options.kernel) {
+        SelectCrc32Kernel(*options.kernel);
+    }
+}
+
+const wchar_t* OptionsHelp() {
+    return
+        L"  --checksum=NAME CRC32 (default, zlib polynomial), CRC32C (Castagnoli polynomial)\n"
+        L"                  or CRC64 (xz polynomial, for millions of files)\n"
+        L"  --kernel=NAME   CRC32 kernel: 16bytes, 16bytes_prefetch, 8bytes, 4x8bytes, 4bytes,\n"
+        L"                  1byte, 1byte_tableless, halfbyte, bitwise,\n"
+        L"                  or auto to pick the fastest one per buffer size on this CPU\n"
+        L"  --archives=MODE list the members of ZIP archives (JAR, DOCX, ...) and tar archives\n"
+        L"                  (also gzip compressed) as ARCHIVE/MEMBER; for ZIP archives\n"
+        L"                  stored takes the CRC32 from the central directory without reading the data,\n"
+        L"                  verify decompresses every member and checks it against the directory;\n"
+        L"                  tar members are hashed as the archive streams by\n"
+        L"  --overlap       instead of checksums, print the share of each pair of files found in\n"
+        L"                  the other one: SHARED_A% SHARED_B% PATH_A PATH_B, for files that differ\n"
+        L"                  in places (disk images, database dumps)\n"
+        L"  --blockmaps=DIR also save the checksum of every 1 MiB block of each file to\n"
+        L"                  DIR/PATH.blockmap, PATH with '/', '\\', ':' and '%' percent-encoded\n"
+        L"  --buffer-memory=MIB\n"
+        L"                  memory for the 2 MiB read buffers shared by all threads (default 1024,\n"
+        L"                  at most 1048576)\n"
+        L"  --huge-pages    back the read buffers with 2 MiB pages where the system allows\n"
+        L"  --tune=MODE     on (default) adapts the read size and the number of concurrent reads\n"
+        L"                  to each device and remembers them for the next run, off reads 1 MiB\n"
+        L"                  at a time, verbose also prints what each device settled on\n"
+        L"  --order=MODE    disk reads files sorted by their place on the disk, in one sweep per\n"
+        L"                  device, to save hard disks from seeking; auto (default) does so for\n"
+        L"                  hard disks only, listed reads them in the order they were found\n"
+        L"  --checkpoints=MODE\n"
+        L"                  on (default) saves how far files of 1 GiB and more have been hashed\n"
+        L"                  every 10 seconds, so an interrupted run continues from there; off\n"
+        L"  --background    read at idle I/O priority and slow down while other programs make\n"
+        L"                  the disk answer later than usual\n"
+        L"  --max-read-rate=MB\n"
+        L"                  megabytes per second all threads together may read\n"
+        L"  --max-read-ops=N\n"
+        L"                  reads per second all threads together may start\n"
+        L"  --duplicates    print only files that have copies, a blank line between groups of\n"
+        L"                  equal size and checksum, the groups that waste the most bytes first,\n"
+        L"                  and the number of groups and wasted bytes to stderr\n"
+        L"  --copy=DIR      copy the files and directories given into DIR and print the checksum\n"
+        L"                  of each copy, computed while copying and checked by reading the copy\n"
+        L"                  back from the disk\n"
+        L"  --manifest=FILE also write every checksum to FILE while hashing, as SFV\n"
+        L"                  (PATH CRC32) if FILE ends in .sfv and as CHECKSUM PATH otherwise;\n"
+        L"                  paths below the directory of FILE are written relative to it;\n"
+        L"                  members of archives are left out\n"
+        L"  --verify=FILE   hash the files listed in the manifest FILE and print PATH: FAILED\n"
+        L"                  for each one whose checksum differs, as soon as it is found\n"
+        L"  --diff A B      print OFFSET LENGTH of every range in which A and B differ, each\n"
+        L"                  either a block map or a file (hashed into one on the fly)\n";
+}
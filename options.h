@@ -0,0 +1,88 @@
+#pragma once
+
+#include "checksum.h"
+#include "crc32dispatch.h"
+#include "qos.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+enum class ReadOrder {
+    Auto,
+    Disk,
+    Listed,
+};
+
+/// command line of the GUI and the console program
+/// flags have the form --name=value or --name, everything else is a path
+struct Options {
+    std::vector<std::wstring> paths;
+
+    /// --checksum=crc32|crc32c|crc64
+    std::optional<ChecksumType> checksum;
+
+    /// --kernel=NAME forces a crc32_fast kernel, --kernel=auto calibrates at startup
+    std::optional<Crc32Kernel> kernel;
+    bool calibrate = false;
+
+    /// --archives=stored lists ZIP members with the CRC32 of their central directory,
+    /// --archives=verify decompresses them and checks it; tar members are hashed either way (equals-cli only)
+    bool archives = false;
+    bool verifyArchives = false;
+
+    /// --overlap cuts files into content-defined chunks and reports how much of each pair is shared (equals-cli only)
+    bool overlap = false;
+
+    /// --blockmaps=DIR saves the checksum of every 1 MiB block of each file to DIR (equals-cli only)
+    std::wstring blockMaps;
+
+    /// --buffer-memory=MIB caps the memory of the read buffer pool, --huge-pages backs it with 2 MiB pages;
+    /// both only take effect before the first file is hashed
+    std::optional<uint64_t> bufferMemory;
+    bool hugePages = false;
+
+    /// --tune=on|off|verbose adapts read size and readers to each device and remembers them (default on),
+    /// verbose prints what was settled on (equals-cli only)
+    bool tune = true;
+    bool verboseTuning = false;
+
+    /// --checkpoints=on|off: huge files save their progress every few seconds and resume from it (default on)
+    bool checkpoints = true;
+
+    /// --order=auto|disk|listed: read files in the order of their place on the disk, on hard disks only (default)
+    /// or on every device, or as listed (equals-cli only)
+    ReadOrder order = ReadOrder::Auto;
+
+    /// --background reads at idle I/O priority and backs off when the disk slows down,
+    /// --max-read-rate=MB and --max-read-ops=N cap the megabytes and reads per second of all threads together
+    QosSettings qos;
+
+    /// --duplicates prints the files in groups of equal size and checksum instead of one by one,
+    /// the groups that waste the most bytes first (equals-cli only)
+    bool duplicates = false;
+
+    /// --copy=DIR copies the files and directories given into DIR, hashing them on the way and
+    /// reading the copies back to check them (equals-cli only)
+    std::wstring copyTo;
+
+    /// --manifest=FILE writes every checksum to FILE as it comes in, as SFV if FILE ends in .sfv
+    /// and as "CHECKSUM PATH" lines otherwise (see manifest.h); archive members are left out
+    /// as --verify can't open them
+    std::wstring manifest;
+
+    /// --verify=FILE hashes the files listed in a manifest and reports the ones that differ (equals-cli only)
+    std::wstring verify;
+
+    /// --diff compares two block maps or files and prints the byte ranges that differ (equals-cli only)
+    bool diff = false;
+};
+
+/// parse arguments without the program name, on failure error describes the offending argument
+bool ParseOptions(const std::vector<std::wstring>& args, Options& options, std::wstring& error);
+
+/// apply the settings that affect the whole process, all of them: flags that are missing get their defaults
+void ApplyOptions(const Options& options);
+
+/// usage text listing all flags
+const wchar_t* OptionsHelp();
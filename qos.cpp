@@ -0,0 +1,179 @@
+#include "qos.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// the bucket holds at most this much time's worth of tokens, so an idle spell doesn't allow a burst
+const double BurstSeconds = 0.1;
+
+/// latency is judged over intervals of this length
+const double IntervalSeconds = 0.1;
+
+/// reads faster than this on average come from the page cache or a device with time to spare
+const double NoticeableLatency = 0.001;
+
+/// an interval this many times slower than the usual latency makes the readers back off
+const double SlowdownFactor = 3;
+
+/// the usual latency is the lowest seen, rising this much per interval so that it follows a
+/// device that is slower for good, but only after minutes
+const double BaselineDrift = 0.001;
+
+/// backing off halves the rate, it recovers by a tenth per interval
+const double BackoffFactor = 0.5;
+const double RecoveryFactor = 1.1;
+const uint64_t MinBytesPerSecond = 1000 * 1000;
+
+struct Governor {
+    /// bytes per second in effect, 0 for no cap
+    uint64_t ByteRate() const {
+        if (settings.maxBytesPerSecond && backoffRate) {
+            return std::min(settings.maxBytesPerSecond, backoffRate);
+        }
+        return std::max(settings.maxBytesPerSecond, backoffRate);
+    }
+
+    /// the interval is over: back off if the reads got slow, recover if not
+    void Judge(double meanLatency, double throughput) {
+        if (meanLatency < NoticeableLatency) {
+            // nothing to judge, the device keeps up
+        } else if (baseline > 0 && meanLatency > SlowdownFactor * baseline) {
+            uint64_t current = ByteRate() ? ByteRate() : (uint64_t)throughput;
+            backoffRate = std::max(MinBytesPerSecond, (uint64_t)(current * BackoffFactor));
+            return;
+        } else {
+            baseline = baseline > 0 ? std::min(baseline * (1 + BaselineDrift), meanLatency) : meanLatency;
+        }
+        if (backoffRate) {
+            backoffRate = (uint64_t)(backoffRate * RecoveryFactor);
+            // lifted once it is above the cap or, without one, well above what the readers take
+            uint64_t ceiling = settings.maxBytesPerSecond ? settings.maxBytesPerSecond : (uint64_t)(2 * throughput);
+            if (backoffRate >= ceiling) {
+                backoffRate = 0;
+            }
+        }
+    }
+
+    std::mutex mtx;
+    QosSettings settings;
+
+    /// token bucket, tokens may go negative: a read takes what it needs and its thread waits out the debt
+    double byteTokens = 0;
+    double readTokens = 0;
+    Clock::time_point refilled = Clock::now();
+
+    /// backoff
+    uint64_t backoffRate = 0;
+    double baseline = 0;
+    Clock::time_point intervalStart = Clock::now();
+    double latencySum = 0;
+    uint32_t samples = 0;
+    uint64_t intervalBytes = 0;
+};
+
+/// never destroyed, detached GUI threads may still be reading while the process exits
+Governor& GetGovernor() {
+    static Governor* governor = new Governor;
+    return *governor;
+}
+
+/// whether reads have to go through the governor at all
+std::atomic<bool> active{ false };
+std::atomic<bool> background{ false };
+
+void LowerIoPriority() {
+#if defined(__linux__) && defined(SYS_ioprio_set)
+    // from linux/ioprio.h, which not every C library ships
+    const int IoprioWhoProcess = 1;
+    const int IoprioClassIdle = 3;
+    const int IoprioClassShift = 13;
+    // "process" 0 is the calling thread
+    syscall(SYS_ioprio_set, IoprioWhoProcess, 0, IoprioClassIdle << IoprioClassShift);
+#elif defined(_WIN32)
+    // low I/O and memory priority for this thread
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+}
+
+} // anonymous namespace
+
+void ConfigureQos(const QosSettings& settings) {
+    Governor& governor = GetGovernor();
+    std::lock_guard<std::mutex> lock(governor.mtx);
+    governor.settings = settings;
+    governor.backoffRate = 0;
+    background = settings.background;
+    active = settings.background || settings.maxBytesPerSecond || settings.maxReadsPerSecond;
+}
+
+bool AwaitReadBudget(uint64_t bytes, uint32_t operations) {
+    if (!active.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    thread_local bool lowered = false;
+    if (background && !lowered) {
+        LowerIoPriority();
+        lowered = true;
+    }
+
+    double wait = 0;
+    {
+        Governor& governor = GetGovernor();
+        std::lock_guard<std::mutex> lock(governor.mtx);
+        Clock::time_point now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - governor.refilled).count();
+        governor.refilled = now;
+        governor.intervalBytes += bytes;
+
+        if (uint64_t rate = governor.ByteRate()) {
+            governor.byteTokens = std::min(governor.byteTokens + elapsed * rate, rate * BurstSeconds) - (double)bytes;
+            if (governor.byteTokens < 0) {
+                wait = -governor.byteTokens / rate;
+            }
+        }
+        if (uint32_t rate = governor.settings.maxReadsPerSecond) {
+            governor.readTokens = std::min(governor.readTokens + elapsed * rate, std::max(1.0, rate * BurstSeconds)) - operations;
+            if (governor.readTokens < 0) {
+                wait = std::max(wait, -governor.readTokens / rate);
+            }
+        }
+    }
+    if (wait > 0) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+    }
+    return wait > 0;
+}
+
+void RecordReadLatency(double seconds) {
+    if (!background.load(std::memory_order_relaxed)) {
+        return;
+    }
+    Governor& governor = GetGovernor();
+    std::lock_guard<std::mutex> lock(governor.mtx);
+    governor.latencySum += seconds;
+    governor.samples++;
+    Clock::time_point now = Clock::now();
+    double elapsed = std::chrono::duration<double>(now - governor.intervalStart).count();
+    if (elapsed >= IntervalSeconds) {
+        governor.Judge(governor.latencySum / governor.samples, governor.intervalBytes / elapsed);
+        governor.intervalStart = now;
+        governor.latencySum = 0;
+        governor.samples = 0;
+        governor.intervalBytes = 0;
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// Quality of service for scans on busy machines. Unthrottled readers can take all of a disk
+// and make the latency of other programs on it spike. In background mode every reading thread
+// asks for idle I/O priority (ioprio_set on Linux, background mode on Windows), and the reads
+// of all threads draw from one token bucket that caps bytes and operations per second. The
+// cap also comes down by itself when reads start taking longer than they used to, the sign of
+// a device that is busy with someone else's requests, and goes back up once they are fast again.
+
+#include <stdint.h>
+
+struct QosSettings {
+    /// idle I/O priority and backoff when the device slows down
+    bool background = false;
+    /// bytes per second all readers together may read, 0 for no cap
+    uint64_t maxBytesPerSecond = 0;
+    /// reads per second all readers together may start, 0 for no cap
+    uint32_t maxReadsPerSecond = 0;
+};
+
+/// takes effect for reads started afterwards
+void ConfigureQos(const QosSettings& settings);
+
+/// blocks until the caps allow reading bytes in the given number of operations;
+/// returns at once if nothing is capped; true if it had to wait
+bool AwaitReadBudget(uint64_t bytes, uint32_t operations = 1);
+
+/// how long a read made after AwaitReadBudget took, for the backoff
+void RecordReadLatency(double seconds);
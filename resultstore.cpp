@@ -0,0 +1,191 @@
+#include "resultstore.h"
+
+#include <string.h>
+#include <wctype.h>
+#include <algorithm>
+
+namespace {
+
+/// names are copied into blocks of this many characters
+const size_t BlockCharacters = 64 * 1024;
+
+uint64_t HashComponent(uint32_t parent, std::wstring_view name) {
+    // FNV-1a over the parent id and the characters
+    uint64_t hash = 0xCBF29CE484222325ull ^ parent;
+    hash *= 0x100000001B3ull;
+    for (wchar_t c : name) {
+        hash ^= (uint64_t)c;
+        hash *= 0x100000001B3ull;
+    }
+    return hash ^ (hash >> 32);
+}
+
+/// call f with every component of path split at '/', empty ones included so the path comes back unchanged
+template <typename F>
+bool ForEachComponent(std::wstring_view path, F f) {
+    size_t begin = 0;
+    while (true) {
+        size_t end = path.find(L'/', begin);
+        if (end == std::wstring_view::npos) {
+            return f(path.substr(begin));
+        }
+        if (!f(path.substr(begin, end - begin))) {
+            return false;
+        }
+        begin = end + 1;
+    }
+}
+
+} // anonymous namespace
+
+uint32_t PathPool::Lookup(uint32_t parent, std::wstring_view name, size_t& slot) const {
+    if (slots.empty()) {
+        slot = 0;
+        return NotFound;
+    }
+    size_t mask = slots.size() - 1;
+    for (slot = (size_t)HashComponent(parent, name) & mask; slots[slot] != NotFound; slot = (slot + 1) & mask) {
+        const Node& node = nodes[slots[slot]];
+        if (node.parent == parent && std::wstring_view(node.name, node.length) == name) {
+            return slots[slot];
+        }
+    }
+    return NotFound;
+}
+
+void PathPool::Grow() {
+    std::vector<uint32_t> newSlots(slots.empty() ? 1024 : 2 * slots.size(), NotFound);
+    size_t mask = newSlots.size() - 1;
+    for (uint32_t id = 0; id < (uint32_t)nodes.size(); id++) {
+        const Node& node = nodes[id];
+        size_t slot = (size_t)HashComponent(node.parent, std::wstring_view(node.name, node.length)) & mask;
+        while (newSlots[slot] != NotFound) {
+            slot = (slot + 1) & mask;
+        }
+        newSlots[slot] = id;
+    }
+    slots = std::move(newSlots);
+}
+
+const wchar_t* PathPool::Store(std::wstring_view name) {
+    if (name.empty()) {
+        return L"";
+    }
+    if (name.size() > blockLeft) {
+        size_t size = std::max(name.size(), BlockCharacters);
+        blocks.emplace_back(new wchar_t[size]);
+        block = blocks.back().get();
+        blockLeft = size;
+    }
+    wchar_t* result = block;
+    memcpy(result, name.data(), name.size() * sizeof(wchar_t));
+    block += name.size();
+    blockLeft -= name.size();
+    return result;
+}
+
+uint32_t PathPool::Add(uint32_t parent, std::wstring_view name, size_t slot) {
+    uint32_t id = (uint32_t)nodes.size();
+    nodes.push_back({ Store(name), (uint32_t)name.size(), parent });
+    if (2 * nodes.size() > slots.size()) {
+        Grow();
+    } else {
+        slots[slot] = id;
+    }
+    return id;
+}
+
+uint32_t PathPool::Intern(std::wstring_view path) {
+    uint32_t id = NotFound;
+    ForEachComponent(path, [&](std::wstring_view name) {
+        size_t slot;
+        uint32_t child = Lookup(id, name, slot);
+        id = child != NotFound ? child : Add(id, name, slot);
+        return true;
+    });
+    return id;
+}
+
+uint32_t PathPool::Find(std::wstring_view path) const {
+    uint32_t id = NotFound;
+    ForEachComponent(path, [&](std::wstring_view name) {
+        size_t slot;
+        id = Lookup(id, name, slot);
+        return id != NotFound;
+    });
+    return id;
+}
+
+void PathPool::Append(uint32_t id, std::wstring& out) const {
+    size_t length = 0;
+    for (uint32_t i = id; i != NotFound; i = nodes[i].parent) {
+        length += nodes[i].length + 1;
+    }
+    if (length == 0) {
+        return;
+    }
+
+    // fill from the end, walking up to the root
+    size_t begin = out.size();
+    out.resize(begin + length - 1);
+    size_t end = out.size();
+    for (uint32_t i = id; i != NotFound; i = nodes[i].parent) {
+        end -= nodes[i].length;
+        memcpy(&out[end], nodes[i].name, nodes[i].length * sizeof(wchar_t));
+        if (end > begin) {
+            out[--end] = L'/';
+        }
+    }
+}
+
+int PathPool::Compare(uint32_t a, uint32_t b) const {
+    thread_local std::wstring left;
+    thread_local std::wstring right;
+    left.clear();
+    right.clear();
+    Append(a, left);
+    Append(b, right);
+
+    size_t length = std::min(left.size(), right.size());
+    for (size_t i = 0; i < length; i++) {
+        wint_t x = towlower((wint_t)left[i]);
+        wint_t y = towlower((wint_t)right[i]);
+        if (x != y) {
+            return x < y ? -1 : 1;
+        }
+    }
+    return left.size() == right.size() ? 0 : left.size() < right.size() ? -1 : 1;
+}
+
+void PathPool::Clear() {
+    std::vector<Node>().swap(nodes);
+    std::vector<uint32_t>().swap(slots);
+    std::vector<std::unique_ptr<wchar_t[]>>().swap(blocks);
+    block = nullptr;
+    blockLeft = 0;
+}
+
+uint32_t ResultStore::Add(std::wstring_view path) {
+    uint32_t id = paths.Intern(path);
+    if (id >= recordOfPath.size()) {
+        recordOfPath.resize(paths.Size(), NotFound);
+    }
+    if (recordOfPath[id] == NotFound) {
+        recordOfPath[id] = (uint32_t)records.size();
+        ResultRecord record;
+        record.path = id;
+        records.push_back(record);
+    }
+    return recordOfPath[id];
+}
+
+uint32_t ResultStore::Find(std::wstring_view path) const {
+    uint32_t id = paths.Find(path);
+    return id != PathPool::NotFound && id < recordOfPath.size() ? recordOfPath[id] : NotFound;
+}
+
+void ResultStore::Clear() {
+    paths.Clear();
+    std::vector<ResultRecord>().swap(records);
+    std::vector<uint32_t>().swap(recordOfPath);
+}
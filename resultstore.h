@@ -0,0 +1,121 @@
+#pragma once
+
+// Compact storage for the result list. Paths are interned one component at a time,
+// so every file in a directory shares the directory's prefix, and the names live in
+// large blocks that are released together when a scan is thrown away. Checksums and
+// sizes stay numbers until the list view asks for their text.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// interned paths split at '/', a path is the id of its last component
+struct PathPool {
+    static constexpr uint32_t NotFound = UINT32_MAX;
+
+    PathPool() = default;
+    PathPool(const PathPool&) = delete;
+    PathPool& operator=(const PathPool&) = delete;
+
+    /// id of path, added if it isn't in the pool yet
+    uint32_t Intern(std::wstring_view path);
+
+    /// id of path or NotFound
+    uint32_t Find(std::wstring_view path) const;
+
+    /// append the full path of id to out
+    void Append(uint32_t id, std::wstring& out) const;
+
+    std::wstring Path(uint32_t id) const {
+        std::wstring result;
+        Append(id, result);
+        return result;
+    }
+
+    /// case insensitive comparison of two full paths, negative if a sorts first
+    int Compare(uint32_t a, uint32_t b) const;
+
+    /// forget every path and release the memory in one go
+    void Clear();
+
+    size_t Size() const {
+        return nodes.size();
+    }
+
+private:
+    /// one path component, the root components have parent NotFound
+    struct Node {
+        const wchar_t* name;
+        uint32_t length;
+        uint32_t parent;
+    };
+
+    uint32_t Lookup(uint32_t parent, std::wstring_view name, size_t& slot) const;
+    uint32_t Add(uint32_t parent, std::wstring_view name, size_t slot);
+    void Grow();
+    const wchar_t* Store(std::wstring_view name);
+
+    std::vector<Node> nodes;
+    /// open addressing table of node ids, NotFound marks a free slot
+    std::vector<uint32_t> slots;
+    std::vector<std::unique_ptr<wchar_t[]>> blocks;
+    /// free part of the last block
+    wchar_t* block = nullptr;
+    size_t blockLeft = 0;
+};
+
+/// the state of one file in the result list
+struct ResultRecord {
+    uint64_t size = 0;
+    uint64_t crc = 0;
+    uint32_t path = PathPool::NotFound;
+    /// percent hashed so far, 100 once crc is final
+    uint8_t progress = 0;
+    /// hashing was paused by the user
+    bool paused = false;
+    /// shown in the result list
+    bool listed = false;
+};
+
+struct ResultStore {
+    static constexpr uint32_t NotFound = UINT32_MAX;
+
+    /// record for path, created empty if there is none yet
+    uint32_t Add(std::wstring_view path);
+
+    /// record of path or NotFound
+    uint32_t Find(std::wstring_view path) const;
+
+    ResultRecord& operator[](uint32_t record) {
+        return records[record];
+    }
+
+    const ResultRecord& operator[](uint32_t record) const {
+        return records[record];
+    }
+
+    size_t Size() const {
+        return records.size();
+    }
+
+    std::wstring Path(uint32_t record) const {
+        return paths.Path(records[record].path);
+    }
+
+    /// case insensitive order of the records' paths
+    int Compare(uint32_t a, uint32_t b) const {
+        return paths.Compare(records[a].path, records[b].path);
+    }
+
+    /// drop all records and paths at once
+    void Clear();
+
+private:
+    PathPool paths;
+    std::vector<ResultRecord> records;
+    /// record of every path id, NotFound for directories
+    std::vector<uint32_t> recordOfPath;
+};
@@ -0,0 +1,382 @@
+#include "tararchive.h"
+#include "inflate.h"
+#include "bufferpool.h"
+#include "mappedfile.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+
+namespace {
+
+const size_t BlockSize = 512;
+
+/// pax headers and GNU long names larger than this are taken for damage
+const size_t MaxMetaSize = 1024 * 1024;
+
+/// numeric header field: octal digits, or GNU's base-256 when the first byte has its top bit set
+bool ParseNumber(const uint8_t* field, size_t length, uint64_t& value) {
+    value = 0;
+    if (field[0] & 0x80) {
+        if (field[0] & 0x40) {
+            // negative
+            return false;
+        }
+        value = field[0] & 0x3F;
+        for (size_t i = 1; i < length; i++) {
+            if (value >> 56) {
+                return false;
+            }
+            value = value << 8 | field[i];
+        }
+        return true;
+    }
+    size_t i = 0;
+    while (i < length && field[i] == ' ') {
+        i++;
+    }
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value << 3 | (uint64_t)(field[i] - '0');
+    }
+    return i == length || field[i] == ' ' || field[i] == 0;
+}
+
+/// header field up to its first NUL
+std::string Field(const uint8_t* field, size_t length) {
+    const uint8_t* end = (const uint8_t*)memchr(field, 0, length);
+    return std::string((const char*)field, end ? (size_t)(end - field) : length);
+}
+
+/// push parser: the archive is fed in pieces of any size and member data is hashed in place
+struct TarParser {
+    enum class State {
+        Header,
+        File,
+        Meta,
+        Skip,
+        Padding,
+        End,
+        Damaged,
+    };
+
+    TarParser(ChecksumType type, std::vector<TarMember>& members) : type(type), members(members) {}
+
+    /// false once nothing more is wanted, at the end marker or on damage
+    bool Feed(const uint8_t* data, size_t length) {
+        while (length) {
+            size_t n = 0;
+            bool inData = state != State::Header;
+            switch (state) {
+            case State::Header:
+                n = std::min(BlockSize - headerFill, length);
+                memcpy(header + headerFill, data, n);
+                headerFill += n;
+                if (headerFill == BlockSize) {
+                    headerFill = 0;
+                    ParseHeader();
+                }
+                break;
+            case State::File:
+                n = (size_t)std::min<uint64_t>(remaining, length);
+                current.hash.crc = UpdateChecksumSkipZeros(type, data, n, current.hash.crc);
+                break;
+            case State::Meta:
+                n = (size_t)std::min<uint64_t>(remaining, length);
+                meta.append((const char*)data, n);
+                break;
+            case State::Skip:
+            case State::Padding:
+                n = (size_t)std::min<uint64_t>(remaining, length);
+                break;
+            case State::End:
+            case State::Damaged:
+                return false;
+            }
+
+            data += n;
+            length -= n;
+            if (inData) {
+                remaining -= n;
+                if (remaining == 0) {
+                    EndOfData();
+                }
+            }
+        }
+        return state != State::End && state != State::Damaged;
+    }
+
+    /// the archive ended between two members, a missing end marker is tolerated as by tar itself
+    bool Complete() const {
+        return state == State::End || (state == State::Header && headerFill == 0);
+    }
+
+    void ParseHeader() {
+        if (std::all_of(header, header + BlockSize, [](uint8_t b) { return b == 0; })) {
+            state = State::End;
+            return;
+        }
+
+        // the checksum is the sum of all header bytes, its own field counted as spaces
+        uint64_t stored;
+        unsigned sum = 0;
+        int signedSum = 0;
+        for (size_t i = 0; i < BlockSize; i++) {
+            uint8_t b = i >= 148 && i < 156 ? ' ' : header[i];
+            sum += b;
+            signedSum += (int8_t)b;
+        }
+        uint64_t size;
+        if (!ParseNumber(header + 148, 8, stored) || (stored != sum && stored != (uint64_t)(unsigned)signedSum)
+            || !ParseNumber(header + 124, 12, size)) {
+            Damage(L"Damaged tar header");
+            return;
+        }
+        sawHeader = true;
+
+        char type = (char)header[156];
+        switch (type) {
+        case 'x':
+        case 'L':
+            // describes the next header
+            metaType = type;
+            meta.clear();
+            if (size > MaxMetaSize) {
+                Damage(L"Damaged tar extended header");
+                return;
+            }
+            StartData(State::Meta, size);
+            return;
+        case 'g':
+        case 'K':
+            // global pax settings and long link targets don't change member names or sizes
+            StartData(State::Skip, size);
+            return;
+        }
+
+        std::string name;
+        if (!paxPath.empty()) {
+            name = std::move(paxPath);
+        } else if (!longName.empty()) {
+            name = std::move(longName);
+        } else {
+            name = Field(header, 100);
+            // POSIX ustar splits long names, GNU tar uses the prefix field for other things
+            std::string prefix = memcmp(header + 257, "ustar\0", 6) == 0 ? Field(header + 345, 155) : std::string();
+            if (!prefix.empty()) {
+                name = prefix + "/" + name;
+            }
+        }
+        if (hasPaxSize) {
+            size = paxSize;
+        }
+        paxPath.clear();
+        longName.clear();
+        hasPaxSize = false;
+
+        bool regular = type == '0' || type == '\0' || type == '7';
+        if (regular && !name.empty() && name.back() == '/') {
+            // directories of pre-POSIX archives
+            regular = false;
+        }
+        if (type == 'S') {
+            // GNU sparse members store a map instead of their data, report rather than miss them
+            TarMember member;
+            member.name = std::move(name);
+            member.hash.error = L"Sparse tar members are not supported";
+            members.push_back(std::move(member));
+        }
+        if (!regular) {
+            StartData(State::Skip, size);
+            return;
+        }
+
+        current = TarMember{};
+        current.name = std::move(name);
+        current.hash.size = size;
+        StartData(State::File, size);
+    }
+
+    void StartData(State dataState, uint64_t size) {
+        state = dataState;
+        remaining = size;
+        padding = (BlockSize - size % BlockSize) % BlockSize;
+        if (remaining == 0) {
+            EndOfData();
+        }
+    }
+
+    void EndOfData() {
+        switch (state) {
+        case State::File:
+            members.push_back(std::move(current));
+            break;
+        case State::Meta:
+            ParseMeta();
+            break;
+        default:
+            break;
+        }
+        if (state == State::Padding || padding == 0) {
+            state = State::Header;
+        } else {
+            state = State::Padding;
+            remaining = padding;
+        }
+    }
+
+    void ParseMeta() {
+        if (metaType == 'L') {
+            longName = meta.substr(0, meta.find('\0'));
+            return;
+        }
+        // pax records are "LENGTH KEY=VALUE\n", LENGTH counting the whole record
+        size_t position = 0;
+        while (position < meta.size()) {
+            char* end;
+            unsigned long long length = strtoull(meta.c_str() + position, &end, 10);
+            size_t space = (size_t)(end - meta.c_str());
+            if (length == 0 || length > meta.size() - position || space >= meta.size() || meta[space] != ' ') {
+                break;
+            }
+            std::string record = meta.substr(space + 1, position + (size_t)length - space - 2);
+            size_t equals = record.find('=');
+            if (equals != std::string::npos) {
+                std::string key = record.substr(0, equals);
+                if (key == "path") {
+                    paxPath = record.substr(equals + 1);
+                } else if (key == "size") {
+                    paxSize = strtoull(record.c_str() + equals + 1, nullptr, 10);
+                    hasPaxSize = true;
+                }
+            }
+            position += (size_t)length;
+        }
+    }
+
+    void Damage(const wchar_t* message) {
+        state = State::Damaged;
+        error = message;
+    }
+
+    ChecksumType type;
+    std::vector<TarMember>& members;
+    State state = State::Header;
+    uint8_t header[BlockSize];
+    size_t headerFill = 0;
+    /// bytes left of the current data or padding
+    uint64_t remaining = 0;
+    /// padding after the current data
+    uint64_t padding = 0;
+    /// at least one valid header, so this is a tar archive
+    bool sawHeader = false;
+    TarMember current;
+
+    char metaType = 0;
+    std::string meta;
+    std::string longName;
+    std::string paxPath;
+    uint64_t paxSize = 0;
+    bool hasPaxSize = false;
+    std::wstring error;
+};
+
+/// feed the decompressed members of a gzip file; false if the compressed data is damaged
+bool FeedGzip(const std::filesystem::path& path, TarParser& parser) {
+    MappedFile file;
+    MappedFile::View view;
+    if (!file.Open(path) || file.size > SIZE_MAX || !file.Map(0, (size_t)file.size, view, true)) {
+        return false;
+    }
+
+    const uint8_t* data = view.data;
+    size_t length = view.size;
+    // concatenated gzip members decompress to one stream
+    while (length >= 18 && data[0] == 0x1F && data[1] == 0x8B && data[2] == 8) {
+        uint8_t flags = data[3];
+        size_t offset = 10;
+        if (flags & 4) {
+            // FEXTRA
+            offset += 2 + (size_t)(data[offset] | data[offset + 1] << 8);
+        }
+        for (uint8_t flag : { (uint8_t)8, (uint8_t)16 }) {
+            // FNAME, FCOMMENT: zero terminated
+            if ((flags & flag) && offset < length) {
+                const void* zero = memchr(data + offset, 0, length - offset);
+                offset = zero ? (size_t)((const uint8_t*)zero - data) + 1 : length;
+            }
+        }
+        if (flags & 2) {
+            // FHCRC
+            offset += 2;
+        }
+        if (offset >= length) {
+            return false;
+        }
+
+        size_t consumed = 0;
+        bool inflated = Inflate(data + offset, length - offset, [&](const uint8_t* bytes, size_t count) {
+            return parser.Feed(bytes, count);
+        }, &consumed);
+        if (!inflated) {
+            // stopped by the parser, or damaged
+            return parser.state == TarParser::State::End || parser.state == TarParser::State::Damaged;
+        }
+        // the trailer holds CRC32 and size of the decompressed data
+        offset += consumed + 8;
+        if (offset > length) {
+            return false;
+        }
+        data += offset;
+        length -= offset;
+    }
+    return true;
+}
+
+/// feed the file as it is
+bool FeedPlain(const std::filesystem::path& path, TarParser& parser) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    PooledBuffer buffer;
+    while (file) {
+        file.read((char*)buffer.data, (std::streamsize)buffer.size);
+        if (file.bad()) {
+            return false;
+        }
+        if (!parser.Feed(buffer.data, (size_t)file.gcount())) {
+            break;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+bool HashTarMembers(const std::filesystem::path& path, ChecksumType type, std::vector<TarMember>& members, std::wstring& error) {
+    members.clear();
+    uint8_t magic[2] = {};
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.read((char*)magic, sizeof(magic))) {
+            return false;
+        }
+    }
+
+    TarParser parser(type, members);
+    bool gzip = magic[0] == 0x1F && magic[1] == 0x8B;
+    bool read = gzip ? FeedGzip(path, parser) : FeedPlain(path, parser);
+    if (!parser.sawHeader) {
+        return false;
+    }
+
+    if (!read) {
+        error = gzip ? L"Damaged gzip data" : L"Failed to read file";
+    } else if (parser.state == TarParser::State::Damaged) {
+        error = parser.error;
+    } else if (!parser.Complete()) {
+        error = L"Tar archive is cut short";
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// Tar archives keep no checksums of their members, but their data follows each header
+// unchanged, so every member can be hashed as the archive streams by: one sequential read,
+// nothing extracted. Understands ustar, pax extended headers and GNU long names; gzip
+// compressed archives are decompressed on the way.
+
+#include "filehash.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct TarMember {
+    /// path inside the archive as stored, usually UTF-8
+    std::string name;
+    FileHash hash;
+};
+
+/// hash every regular file in the archive with one pass over it.
+/// False if path doesn't start with a tar header (compressed or not), nothing was found then.
+/// Otherwise true, with error set if the archive is damaged or cut short after the members found so far.
+bool HashTarMembers(const std::filesystem::path& path, ChecksumType type, std::vector<TarMember>& members, std::wstring& error);
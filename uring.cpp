@@ -0,0 +1,221 @@
+#include "uring.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+template <typename T>
+T* At(void* base, unsigned offset) {
+    return (T*)((char*)base + offset);
+}
+
+unsigned LoadAcquire(const unsigned* value) {
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(unsigned* value, unsigned newValue) {
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+}
+
+} // anonymous namespace
+
+IoUring::IoUring(unsigned entries) {
+    io_uring_params params{};
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        return;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        sqRingSize = cqRingSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cqRing = singleMmap ? sqRing
+        : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void* sqeMemory = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqeMemory == MAP_FAILED) {
+        if (sqeMemory != MAP_FAILED) munmap(sqeMemory, params.sq_entries * sizeof(io_uring_sqe));
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        sqRing = cqRing = nullptr;
+        close(fd);
+        return;
+    }
+
+    sqes = (io_uring_sqe*)sqeMemory;
+    sqTail = At<unsigned>(sqRing, params.sq_off.tail);
+    sqMask = At<unsigned>(sqRing, params.sq_off.ring_mask);
+    sqArray = At<unsigned>(sqRing, params.sq_off.array);
+    cqHead = At<unsigned>(cqRing, params.cq_off.head);
+    cqTail = At<unsigned>(cqRing, params.cq_off.tail);
+    cqMask = At<unsigned>(cqRing, params.cq_off.ring_mask);
+    cqes = At<io_uring_cqe>(cqRing, params.cq_off.cqes);
+
+    // the completion queue is at least as large, so a full submission queue can always complete
+    this->entries = params.sq_entries;
+    ringFd = fd;
+}
+
+IoUring::~IoUring() {
+    if (ringFd < 0) {
+        return;
+    }
+    munmap(sqes, entries * sizeof(io_uring_sqe));
+    if (cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    munmap(sqRing, sqRingSize);
+    close(ringFd);
+}
+
+io_uring_sqe* IoUring::NextSqe() {
+    if (ringFd < 0 || queued == entries) {
+        return nullptr;
+    }
+    // only this thread produces, the kernel consumed everything in the last SubmitAndWait
+    unsigned tail = *sqTail + queued;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    queued++;
+    return sqe;
+}
+
+bool IoUring::Openat(const char* path, int flags, uint64_t userData) {
+    io_uring_sqe* sqe = NextSqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)path;
+    sqe->open_flags = (uint32_t)flags;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool IoUring::Statx(const char* path, unsigned mask, struct statx* result, uint64_t userData) {
+    io_uring_sqe* sqe = NextSqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)path;
+    sqe->len = mask;
+    sqe->off = (uint64_t)(uintptr_t)result;
+    sqe->statx_flags = AT_STATX_SYNC_AS_STAT;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool IoUring::Read(int fd, void* buffer, unsigned length, uint64_t offset, uint64_t userData, bool linkNext) {
+    io_uring_sqe* sqe = NextSqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->flags = linkNext ? IOSQE_IO_HARDLINK : 0;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool IoUring::Close(int fd, uint64_t userData) {
+    io_uring_sqe* sqe = NextSqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool IoUring::SubmitAndWait(const std::function<void(uint64_t userData, int result)>& done) {
+    unsigned total = queued;
+    unsigned unsubmitted = queued;
+    StoreRelease(sqTail, *sqTail + queued);
+    queued = 0;
+
+    // once a submission is refused, the operations the kernel already took are still waited for:
+    // they would otherwise write into buffers or close descriptors after the caller moved on
+    bool refused = false;
+    unsigned completed = 0;
+    while (completed < total - (refused ? unsubmitted : 0)) {
+        unsigned submit = refused ? 0 : unsubmitted;
+        unsigned wait = total - (refused ? unsubmitted : 0) - completed;
+        int ret = (int)syscall(__NR_io_uring_enter, ringFd, submit, wait, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret < 0 && errno != EINTR) {
+            if (refused) {
+                // completions reach the queue without waiting in the kernel, the pause lets it
+                // run the work this thread owes it
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            refused = true;
+        } else if (ret > 0) {
+            unsubmitted -= (unsigned)ret < unsubmitted ? (unsigned)ret : unsubmitted;
+        }
+
+        unsigned head = *cqHead;
+        unsigned tail = LoadAcquire(cqTail);
+        for (; head != tail; head++, completed++) {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            done(cqe.user_data, cqe.res);
+        }
+        StoreRelease(cqHead, head);
+    }
+    failed = refused;
+    return !refused;
+}
+
+#else
+
+IoUring::IoUring(unsigned entries) {
+    (void)entries;
+}
+
+IoUring::~IoUring() {}
+
+struct io_uring_sqe* IoUring::NextSqe() {
+    return nullptr;
+}
+
+bool IoUring::Openat(const char*, int, uint64_t) {
+    return false;
+}
+
+bool IoUring::Statx(const char*, unsigned, struct statx*, uint64_t) {
+    return false;
+}
+
+bool IoUring::Read(int, void*, unsigned, uint64_t, uint64_t, bool) {
+    return false;
+}
+
+bool IoUring::Close(int, uint64_t) {
+    return false;
+}
+
+bool IoUring::SubmitAndWait(const std::function<void(uint64_t, int)>&) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+// Minimal io_uring queue for batching file system calls (Linux 5.6+).
+// Talks to the kernel with raw system calls, so liburing isn't needed; on other
+// systems, or when the kernel or a seccomp filter refuses io_uring, Valid() is false.
+
+#include <stdint.h>
+#include <functional>
+
+struct statx;
+
+struct IoUring {
+    /// entries is the number of operations that can be queued before SubmitAndWait
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool Valid() const {
+        return ringFd >= 0 && !failed;
+    }
+
+    /// number of operations that fit into the queue
+    unsigned Capacity() const {
+        return entries;
+    }
+
+    // queue an operation, userData is passed back with its result; false if the queue is full
+    // path and result must stay valid until SubmitAndWait returns
+    bool Openat(const char* path, int flags, uint64_t userData);
+    bool Statx(const char* path, unsigned mask, struct statx* result, uint64_t userData);
+    /// with linkNext the next queued operation starts after this one, even if it fails
+    bool Read(int fd, void* buffer, unsigned length, uint64_t offset, uint64_t userData, bool linkNext = false);
+    bool Close(int fd, uint64_t userData);
+
+    /// submit everything queued and wait until all of it completed, calling done with each
+    /// result (a negative errno on failure); returns false if the kernel rejected the submission,
+    /// what it took has completed and was passed to done by then, the rest never runs
+    bool SubmitAndWait(const std::function<void(uint64_t userData, int result)>& done);
+
+private:
+    struct io_uring_sqe* NextSqe();
+
+    int ringFd = -1;
+    /// the kernel refused a submission, the queues may be out of step
+    bool failed = false;
+    unsigned entries = 0;
+    unsigned queued = 0;
+
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    struct io_uring_sqe* sqes = nullptr;
+
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    struct io_uring_cqe* cqes = nullptr;
+};
@@ -0,0 +1,243 @@
+#include "ziparchive.h"
+#include "crc32.h"
+#include "inflate.h"
+
+#include "mappedfile.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace {
+
+const uint32_t LocalHeaderSignature = 0x04034B50;
+const uint32_t CentralHeaderSignature = 0x02014B50;
+const uint32_t EndSignature = 0x06054B50;
+const uint32_t Zip64EndSignature = 0x06064B50;
+const uint32_t Zip64LocatorSignature = 0x07064B50;
+
+const size_t LocalHeaderSize = 30;
+const size_t CentralHeaderSize = 46;
+const size_t EndSize = 22;
+const size_t Zip64EndSize = 56;
+const size_t Zip64LocatorSize = 20;
+const size_t MaxCommentSize = 0xFFFF;
+
+uint16_t Read16(const uint8_t* p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+uint32_t Read32(const uint8_t* p) {
+    return (uint32_t)Read16(p) | (uint32_t)Read16(p + 2) << 16;
+}
+
+uint64_t Read64(const uint8_t* p) {
+    return (uint64_t)Read32(p) | (uint64_t)Read32(p + 4) << 32;
+}
+
+/// fill in the fields the central header marked with 0xFFFFFFFF from the ZIP64 extra field
+bool ApplyZip64Extra(const uint8_t* extra, size_t length, ZipMember& member, bool wideSize, bool wideCompressed, bool wideOffset) {
+    while (length >= 4) {
+        uint16_t id = Read16(extra);
+        uint16_t size = Read16(extra + 2);
+        if (size > length - 4) {
+            return false;
+        }
+        if (id == 0x0001) {
+            // present in this order, only the ones that didn't fit
+            const uint8_t* field = extra + 4;
+            const uint8_t* end = field + size;
+            const bool wide[3] = { wideSize, wideCompressed, wideOffset };
+            uint64_t* values[3] = { &member.size, &member.compressedSize, &member.localHeaderOffset };
+            for (int i = 0; i < 3; i++) {
+                if (!wide[i]) {
+                    continue;
+                }
+                if (end - field < 8) {
+                    return false;
+                }
+                *values[i] = Read64(field);
+                field += 8;
+            }
+            return true;
+        }
+        extra += 4 + size;
+        length -= 4 + size;
+    }
+    return !wideSize && !wideCompressed && !wideOffset;
+}
+
+/// decompress one member of the mapped archive
+FileHash HashMember(const uint8_t* archive, size_t archiveSize, const ZipMember& member, ChecksumType type) {
+    FileHash result{};
+    if (member.encrypted) {
+        result.error = L"Encrypted archive member";
+        return result;
+    }
+    if (member.method != 0 && member.method != 8) {
+        result.error = L"Unsupported compression method " + std::to_wstring(member.method);
+        return result;
+    }
+
+    if (member.localHeaderOffset > archiveSize || archiveSize - member.localHeaderOffset < LocalHeaderSize
+        || Read32(archive + member.localHeaderOffset) != LocalHeaderSignature) {
+        result.error = L"Damaged ZIP local header";
+        return result;
+    }
+    const uint8_t* header = archive + member.localHeaderOffset;
+    uint64_t dataOffset = member.localHeaderOffset + LocalHeaderSize + Read16(header + 26) + Read16(header + 28);
+    if (dataOffset > archiveSize || archiveSize - dataOffset < member.compressedSize) {
+        result.error = L"Damaged ZIP local header";
+        return result;
+    }
+    const uint8_t* data = archive + dataOffset;
+    size_t length = (size_t)member.compressedSize;
+
+    // the CRC32 to check against the directory, and the requested checksum if it is another one
+    uint32_t crc = 0;
+    auto hash = [&](const uint8_t* bytes, size_t count) {
+        crc = crc32_fast(bytes, count, crc);
+        if (type != ChecksumType::Crc32) {
+            result.crc = UpdateChecksum(type, bytes, count, result.crc);
+        }
+        result.size += count;
+        return true;
+    };
+    if (member.method == 0) {
+        hash(data, length);
+    } else if (!Inflate(data, length, hash)) {
+        result.error = L"Damaged compressed data";
+        return result;
+    }
+    if (type == ChecksumType::Crc32) {
+        result.crc = crc;
+    }
+
+    if (result.size != member.size || crc != member.crc) {
+        result.error = L"Contents don't match the archive directory";
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+bool ReadZipDirectory(const std::filesystem::path& path, std::vector<ZipMember>& members, std::wstring& error) {
+    members.clear();
+    MappedFile file;
+    if (!file.Open(path)) {
+        error = L"Failed to open file";
+        return false;
+    }
+    if (file.size < EndSize) {
+        error = L"Not a ZIP archive";
+        return false;
+    }
+
+    // the end record sits behind the directory, followed only by a comment of up to 64 KiB
+    size_t tailSize = (size_t)std::min<uint64_t>(file.size, EndSize + MaxCommentSize + Zip64LocatorSize);
+    uint64_t tailOffset = file.size - tailSize;
+    MappedFile::View tail;
+    if (!file.Map(tailOffset, tailSize, tail)) {
+        error = L"Failed to read file";
+        return false;
+    }
+    size_t end = SIZE_MAX;
+    for (size_t i = tailSize - EndSize + 1; i-- > 0; ) {
+        if (Read32(tail.data + i) == EndSignature && i + EndSize + Read16(tail.data + i + 20) <= tailSize) {
+            end = i;
+            break;
+        }
+    }
+    if (end == SIZE_MAX) {
+        error = L"Not a ZIP archive";
+        return false;
+    }
+
+    uint64_t entries = Read16(tail.data + end + 10);
+    uint64_t directorySize = Read32(tail.data + end + 12);
+    uint64_t directoryOffset = Read32(tail.data + end + 16);
+    // data in front of the archive, as in self-extracting executables, moves every offset
+    uint64_t base = 0;
+
+    if (end >= Zip64LocatorSize && Read32(tail.data + end - Zip64LocatorSize) == Zip64LocatorSignature) {
+        MappedFile::View zip64;
+        if (!file.Map(Read64(tail.data + end - Zip64LocatorSize + 8), Zip64EndSize, zip64) || Read32(zip64.data) != Zip64EndSignature) {
+            error = L"Damaged ZIP64 end of central directory";
+            return false;
+        }
+        entries = Read64(zip64.data + 32);
+        directorySize = Read64(zip64.data + 40);
+        directoryOffset = Read64(zip64.data + 48);
+    } else {
+        uint64_t endOffset = tailOffset + end;
+        if (directoryOffset + directorySize > endOffset) {
+            error = L"Damaged ZIP central directory";
+            return false;
+        }
+        base = endOffset - directorySize - directoryOffset;
+    }
+
+    if (directorySize == 0) {
+        return entries == 0;
+    }
+    MappedFile::View directory;
+    if (directorySize > SIZE_MAX || !file.Map(base + directoryOffset, (size_t)directorySize, directory)) {
+        error = L"Damaged ZIP central directory";
+        return false;
+    }
+
+    const uint8_t* p = directory.data;
+    const uint8_t* directoryEnd = directory.data + directory.size;
+    members.reserve((size_t)std::min<uint64_t>(entries, directory.size / CentralHeaderSize));
+    for (uint64_t i = 0; i < entries; i++) {
+        if (directoryEnd - p < (ptrdiff_t)CentralHeaderSize || Read32(p) != CentralHeaderSignature) {
+            error = L"Damaged ZIP central directory";
+            return false;
+        }
+        uint16_t nameLength = Read16(p + 28);
+        uint16_t extraLength = Read16(p + 30);
+        uint16_t commentLength = Read16(p + 32);
+        if (directoryEnd - p < (ptrdiff_t)(CentralHeaderSize + nameLength + extraLength + commentLength)) {
+            error = L"Damaged ZIP central directory";
+            return false;
+        }
+
+        ZipMember member;
+        member.encrypted = (Read16(p + 8) & 1) != 0;
+        member.method = Read16(p + 10);
+        member.crc = Read32(p + 16);
+        member.compressedSize = Read32(p + 20);
+        member.size = Read32(p + 24);
+        member.localHeaderOffset = Read32(p + 42);
+        member.name.assign((const char*)p + CentralHeaderSize, nameLength);
+        if (!ApplyZip64Extra(p + CentralHeaderSize + nameLength, extraLength, member,
+            member.size == 0xFFFFFFFF, member.compressedSize == 0xFFFFFFFF, member.localHeaderOffset == 0xFFFFFFFF)) {
+            error = L"Damaged ZIP64 extra field";
+            return false;
+        }
+        member.localHeaderOffset += base;
+        p += CentralHeaderSize + nameLength + extraLength + commentLength;
+
+        if (member.name.empty() || member.name.back() == '/') {
+            continue;
+        }
+        members.push_back(std::move(member));
+    }
+    return true;
+}
+
+std::vector<FileHash> HashZipMembers(const std::filesystem::path& path, const std::vector<ZipMember>& members, ChecksumType type) {
+    std::vector<FileHash> results(members.size());
+    // one mapping for the whole archive, members are often tiny
+    MappedFile file;
+    MappedFile::View archive;
+    if (!file.Open(path) || file.size > SIZE_MAX || (file.size && !file.Map(0, (size_t)file.size, archive))) {
+        for (FileHash& result : results) {
+            result.error = L"Failed to read file";
+        }
+        return results;
+    }
+    for (size_t i = 0; i < members.size(); i++) {
+        results[i] = HashMember(archive.data, archive.size, members[i], type);
+    }
+    return results;
+}
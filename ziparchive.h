@@ -0,0 +1,33 @@
+#pragma once
+
+// ZIP archives (also JAR, APK, DOCX and the other Office formats) store the CRC32 and the
+// uncompressed size of every member in their central directory, at the end of the file.
+// Reading only that directory compares archive contents without decompressing anything.
+
+#include "filehash.h"
+
+#include <stdint.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct ZipMember {
+    /// path inside the archive with '/' separators, as stored (UTF-8 for most archivers)
+    std::string name;
+    uint64_t size = 0;
+    uint64_t compressedSize = 0;
+    uint64_t localHeaderOffset = 0;
+    uint32_t crc = 0;
+    /// 0 stored, 8 deflate
+    uint16_t method = 0;
+    bool encrypted = false;
+};
+
+/// the file members of the archive's central directory, ZIP64 included; directories are left out.
+/// Only the end of the file and the directory are memory mapped.
+/// False with error set if path isn't a ZIP archive or the directory is damaged.
+bool ReadZipDirectory(const std::filesystem::path& path, std::vector<ZipMember>& members, std::wstring& error);
+
+/// decompress the members and compute their checksums, a member's error is set if it can't be
+/// decompressed or doesn't match the CRC32 and size in the directory
+std::vector<FileHash> HashZipMembers(const std::filesystem::path& path, const std::vector<ZipMember>& members, ChecksumType type);